@@ -35,6 +35,7 @@ SOFTWARE.
 #include <QApplication>
 #include <QTimer>
 #include <QImage>
+#include <QThread>
 #include <QFileDialog>
 
 #include <QVector>
@@ -45,11 +46,17 @@ SOFTWARE.
 #include <QDateTime>
 
 #include "configStorage.h"
+#include "magApply.h"
+#include "magLoader.h"
+#include "magSolver.h"
+#include "magModel.h"
 
 #include "customFloatingWindow.h"
 #include "customMdiSubWindow.h"
 
+#include <algorithm>
 #include <cmath>
+#include <memory>
 
 #ifdef USE_MAP_VIEW
 #include "customMapView.h"
@@ -66,12 +73,15 @@ SOFTWARE.
 #include "gl_pcloud_entity.h"
 #include "gl_polyline_entity.h"
 
+// colored by the magnitude, or by the mask when it is given (0: not used, 1: outlier, 2: inlier)
 class gl_mag_entity : public gl_pcloud_entity
 {
 public:
-    explicit gl_mag_entity(const QString &name, const QList<QList<double> > &data, QObject *parent = 0) : gl_pcloud_entity(parent)
+    explicit gl_mag_entity(const QString &name, std::shared_ptr<const magDataSet> data,
+                           std::shared_ptr<const std::vector<uint8_t> > mask = nullptr, QObject *parent = 0) : gl_pcloud_entity(parent)
     {
         _data = data;
+        _mask = mask;
         _name = name;
     }
     virtual ~gl_mag_entity()
@@ -92,7 +102,8 @@ protected:
         _localOrigin = QVector3D(0.0f, 0.0f, 0.0f);
         setObjectName(_name);
 
-        quint64 nPoints = _data.size();
+        const magDataSpan d = _data->span();
+        quint64 nPoints = d.size();
 
         _rgb = 0;
         _amp = 3;
@@ -111,19 +122,24 @@ protected:
         GLfloat *w=_vertex;
         for(quint64 i=0; i<nPoints; i++)
         {
-            const auto &v=_data.at(i);
-
             float radius = 1.0f;
-            float x = v.at(1);
-            float y = v.at(2);
-            float z = v.at(3);
+            float x = d.x[i];
+            float y = d.y[i];
+            float z = d.z[i];
 
-            float t=std::sqrt(x*x + y*y + z*z);
+            float t = d.w[i];
 
             float amp;
             float rng = t;
 
-            if(t<0.95f) amp=10.0f;
+            if(_mask)
+            {
+                const uint8_t m=(*_mask)[i];
+                if(m==0) amp=10.0f;
+                else if(m==2) amp=0.5f*255.0f;
+                else amp=255.0f-10.0f;
+            }
+            else if(t<0.95f) amp=10.0f;
             else if(t<1.05f) amp=0.5f*255.0f;
             else  amp=255.0f-10.0f;
 
@@ -142,7 +158,8 @@ protected:
 
 private:
     QString _name;
-    QList<QList<double> > _data;
+    std::shared_ptr<const magDataSet> _data;
+    std::shared_ptr<const std::vector<uint8_t> > _mask;
 };
 
 #endif
@@ -178,6 +195,14 @@ MainWindow::MainWindow(QWidget *parent)
     _stockModelPending = nullptr;
     _stockModel = nullptr;
 
+    _loader = nullptr;
+    _solver = nullptr;
+    _stream = nullptr;
+    _norHash = 0;
+    _frameTimer = nullptr;
+    _model = MAG_MODEL_QUADRATIC;
+    updateCancel();
+
     ui->peLog->setCenterOnScroll(true);
     //ui->mdiArea->tileSubWindows();
 
@@ -213,13 +238,48 @@ MainWindow::MainWindow(QWidget *parent)
     });
 
     connect(ui->menuFile, &QMenu::aboutToShow, this, [=](){
-        ui->actionExecute->setEnabled(_norDataSet.size()>0);
+        ui->actionExecute->setEnabled(_norDataSet && _norDataSet->size()>0 && _solver==nullptr && _loader==nullptr);
         ui->actionExport->setEnabled(_k.size()>0);
     });
+
+    connect(ui->menuComm, &QMenu::aboutToShow, this, [=](){
+        ui->actionRecord->setEnabled(_stream==nullptr);
+        ui->actionRecord->setChecked(!_recordFile.isEmpty());
+        ui->actionRefine->setEnabled(_stream!=nullptr);
+    });
+}
+
+// waits for the thread of a canceled loader or solver, the worker is deleted
+// by QThread::finished() and the thread here
+static void joinWorker(QObject *worker)
+{
+    QThread *x=worker->thread();
+    x->quit();
+    x->wait();
+    delete x;
 }
 
 MainWindow::~MainWindow()
 {
+    // the workers and their queued results refer to this window
+    if(_loader!=nullptr)
+    {
+        _loader->cancel();
+        joinWorker(_loader);
+        _loader = nullptr;
+    }
+    if(_solver!=nullptr)
+    {
+        _solver->cancel();      // the solver callbacks stop Ceres after the current iteration
+        joinWorker(_solver);
+        _solver = nullptr;
+    }
+    if(_stream!=nullptr)
+    {
+        _frameTimer->stop();
+        delete _stream;     // joins the source, parser and recorder threads
+        _stream = nullptr;
+    }
     delete ui;
 }
 
@@ -450,243 +510,640 @@ void MainWindow::create_qcp_example_realtime()
 #endif
 
 
+#include "magRecorder.h"
+
+// the recorder is attached when a stream starts, csv or magbin by the extension
+void MainWindow::on_actionRecord_triggered(bool checked)
+{
+    _recordFile.clear();
+    if(checked)
+    {
+        auto fileName=QFileDialog::getSaveFileName(this,"Record live streams to",lastPath("record"),"CSV Files (*.csv);;Dataset (*.magbin)");
+        if(!fileName.isEmpty())
+        {
+            setLastPath("record",fileName);
+            _recordFile = fileName;
+        }
+    }
+    ui->actionRecord->setChecked(!_recordFile.isEmpty());
+}
+
 #include "serialPortDialog.h"
+#include "magSerialSource.h"
 #include <QSerialPort>
 void MainWindow::on_actionSerial_port_triggered()
 {
+    if(_stream!=nullptr)
+    {
+        qWarning()<<_stream->name()<<"is streaming.";
+        return;
+    }
+
     serialPortDialog dlg(this);
     if(dlg.exec()==QDialog::Accepted)
     {
-        auto port = dlg.get(this);
-        if(port->open(QIODevice::ReadWrite))
-        {
-            qDebug()<< "Serial port is opened" << port->portName();
-
-
-            port->close();  //this is just example code
-        }
-        else
-        {
-            qDebug()<< "Serial port open failed" << port->portName();
-        }
+        startStream(new magSerialSource(dlg.get(nullptr)), dlg.framing(), dlg.forgetting());
     }
 }
 
 #include "tcpClientDialog.h"
+#include "magTcpSource.h"
 
 void MainWindow::on_actionTCP_Client_triggered()
 {
+    if(_stream!=nullptr)
+    {
+        qWarning()<<_stream->name()<<"is streaming.";
+        return;
+    }
+
     tcpClientDialog dlg(this);
     if(dlg.exec()==QDialog::Accepted)
     {
-
+        auto p=dlg.param();
+        const int port=p["lePort"].toInt();
+        if(port<=0)
+        {
+            qWarning()<<"Port number is wrong.";
+            return;
+        }
+        startStream(new magTcpSource(p["leAddr"].toString(), (quint16)port), p["cbFraming"].toInt(), p.value("sbForgetting", 1.0).toDouble());
     }
 }
 
-QList<double> parse(const QStringList &tokens)
+static QVector<double> toVector(const double *v, size_t n)
 {
-    QList<double> ret;
-    for(const auto &i:tokens)
+    QVector<double> ret((int)n);
+    std::copy(v, v+n, ret.begin());
+    return ret;
+}
+
+static QVariantList toColumns(const magDataSet &d)
+{
+    QVariantList columns;
+    columns.append(QVariant::fromValue(toVector(d.t(), d.size())));
+    columns.append(QVariant::fromValue(toVector(d.x(), d.size())));
+    columns.append(QVariant::fromValue(toVector(d.y(), d.size())));
+    columns.append(QVariant::fromValue(toVector(d.z(), d.size())));
+    columns.append(QVariant::fromValue(toVector(d.w(), d.size())));
+    return columns;
+}
+
+// unit mean magnitude for the 3D view
+static std::shared_ptr<const magDataSet> scaledDataSet(const magDataSet &data)
+{
+    const size_t n=data.size();
+    double sum=0.0;
+    const double *w=data.w();
+    for(size_t i=0;i<n;i++) sum += w[i];
+
+    double scale=n/sum;
+    qInfo()<<"Preliminary scale factor is" << scale;
+
+    auto sca=std::make_shared<magDataSet>();
+    sca->resize(n);
+    std::copy(data.t(), data.t()+n, sca->t());
+    for(size_t i=0;i<n;i++)
     {
-        bool ok;
-        auto d=i.toDouble(&ok);
-        if(!ok) return QList<double>();
-        ret.append(d);
+        sca->x()[i] = data.x()[i] * scale;
+        sca->y()[i] = data.y()[i] * scale;
+        sca->z()[i] = data.z()[i] * scale;
+        sca->w()[i] = data.w()[i] * scale;
     }
-    return ret;
+    return sca;
+}
+
+static QVariantMap rawPlot(const magDataSet &data)
+{
+    QVariantMap m;
+    QStringList header;
+    header << "Time" << "raw X" << "raw Y" << "raw Z" << "total";
+    m["headers"] = header;
+    m["columns"] = toColumns(data);
+    m["realtime"] = false;
+    return m;
 }
 
+// builds the scaled dataset and the plot columns in the loader thread
+class magViewLoader : public magLoader
+{
+public:
+    explicit magViewLoader(const QString &fileName, QObject *parent = nullptr) : magLoader(fileName, parent)
+    {
+    }
+
+    std::shared_ptr<const magDataSet> scaled() const {return _scaled;}
+    const QVariantMap &plot() const {return _plot;}
 
+protected:
+    virtual int prepare(magDataSet &data)
+    {
+        if(data.size()<=50) return 0;
+        _scaled = scaledDataSet(data);
+        _plot = rawPlot(data);
+        return 1;
+    }
+
+private:
+    std::shared_ptr<const magDataSet> _scaled;
+    QVariantMap _plot;
+};
 
 void MainWindow::on_actionOpen_triggered()
 {
-    auto fileName=QFileDialog::getOpenFileName(this,"Select a log file",lastPath("mag"),"Magnetometer log file (*.txt;*.csv)");
+    if(_loader!=nullptr)
+    {
+        qWarning()<<"Loading"<<_loader->fileName()<<"is in progress.";
+        return;
+    }
+    if(_solver!=nullptr)
+    {
+        qWarning()<<"Solving is in progress.";
+        return;
+    }
+
+    auto fileName=QFileDialog::getOpenFileName(this,"Select a log file",lastPath("mag"),"Magnetometer log file (*.txt;*.csv);;Recorded dataset (*.magbin)");
     if(!fileName.isEmpty())
     {
         setLastPath("mag",fileName);
 
-        QFile f(fileName);
-        if(f.open(QFile::ReadOnly|QFile::Text))
-        {
-            QList<QList<double> > dataset;
-            for(;;)
-            {
-                bool lineOk=false;
-                auto bytes=f.readLine();
-                if(bytes.isEmpty()) break;
-
-                QString line=QString::fromLocal8Bit(bytes);
-                line.remove("\n");
-                auto tokens1 = line.split(',');
-                auto tokens2 = line.split(' ');
-                auto data1 = parse(tokens1);
-                auto data2 = parse(tokens2);
-                if(!data1.empty()||!data2.empty())
-                {
-                    auto &data = data1.size()>data2.size() ? data1 : data2;
-                    if(data.size()>=3)
-                    {
-                        if(dataset.size())
-                        {
-                            if(dataset.back().size() == data.size())
-                            {
-                                dataset.append(data);
-                                lineOk = true;
-                            }
-                        }
-                        else
-                        {
-                            dataset.append(data);
-                            lineOk = true;
-                        }
-                    }
-                }
-                /*if(lineOk)
-                {
-                    qDebug()<<dataset.back();
-                }*/
+        QFileInfo fi(fileName);
+        auto loader=new magViewLoader(fileName);
+        _loader = loader;
+        updateCancel();
 
-            }
-            f.close();
+        connect(loader, &magLoader::progress, this, [=](quint64 current, quint64 total, QString label)
+        {
+            if(total>0) logMessage(1, QString("%1 %2 ... %3%").arg(label, fi.fileName()).arg(100*current/total));
+            else logMessage(1, QString("%1 %2 ...").arg(label, fi.fileName()));
+        });
 
-            if(dataset.size()>50)
+        connect(loader, &magLoader::done, this, [=](QObject *)
+        {
+            _loader = nullptr;
+            updateCancel();
+            if(loader->result())
             {
-                loaded(dataset);
+                logMessage(1, QString("%1 is loaded").arg(fi.fileName()));
+                loaded(loader->takeDataSet(), loader->scaled(), loader->plot());
             }
-            else
+            else if(!loader->isCanceled())
             {
                 qWarning()<<"Not enough data";
             }
+            loader->thread()->quit();
+        });
 
-        }
+        QThread *x=new QThread;
+        connect(x, &QThread::finished, loader, &QObject::deleteLater);
+        connect(x, &QThread::finished, x, &QObject::deleteLater);
+        loader->moveToThread(x);
+        x->start();
+
+        QMetaObject::invokeMethod(loader, "run");
+    }
+}
+
+// Esc works without opening the menu, the action follows the background jobs
+void MainWindow::updateCancel(void)
+{
+    ui->actionCancel->setEnabled(_loader!=nullptr || _solver!=nullptr || _stream!=nullptr);
+}
+
+void MainWindow::on_actionCancel_triggered()
+{
+    if(_loader!=nullptr) _loader->cancel();
+    if(_solver!=nullptr) _solver->cancel();
+    if(_stream!=nullptr) stopStream();
+}
+
+void MainWindow::loaded(magDataSet &&dataSet, std::shared_ptr<const magDataSet> scaled, const QVariantMap &plot)
+{
+    if(_solver!=nullptr)
+    {
+        qWarning()<<"Solving is in progress, the loaded data is discarded.";
+        return;
+    }
+
+    _norDataSet = std::make_shared<const magDataSet>(std::move(dataSet));
+    _norHash = 0;
+    _scaDataSet = scaled;
+
+    auto p=new qcpPlotView(plot, this);
+    auto sub=new customMdiSubWindow(p->widget(), this);
+    ui->mdiArea->addSubWindow(sub);
+    sub->setWindowTitle("Raw Data");
+    sub->show();
+
+    {
+        QByteArray dummy;
+        dummy.append((char)0);
+        _glWidget->delayLoad(new gl_mag_entity("raw data",_scaDataSet), dummy);
+    }
+}
+
+
+#define LIVE_FRAME_MS       33      // GUI frame timer of a live stream
+#define LIVE_STATS_MS       1000    // status bar and online fit interval
+#define LIVE_PLOT_HISTORY   30.0    // seconds shown in the live plot
+#define LIVE_FRAME_SAMPLES  65536   // samples taken from the ring at once
+#define LIVE_FRAME_BUDGET   (4*LIVE_FRAME_SAMPLES)  // samples per frame, the rest waits for the next frame
+#define LIVE_STAMP_WINDOW   60.0    // time stamps this close to the wall clock are sender stamps (magReplay --stamp)
+
+// The frame timer moves the parsed samples of sensor 0 into _liveDataSet and
+// the online calibration, the stream threads never wait for the GUI.
+// Cancel stops the stream, the recorded samples become the dataset to calibrate.
+// lambda: forgetting factor of the online fit, 1 keeps every sample
+void MainWindow::startStream(magStreamSource *source, int framing, double lambda)
+{
+    _stream = new magStream(source, this);
+    updateCancel();
+    _stream->setFraming(framing);
+    if(!_recordFile.isEmpty()) _stream->setRecorder(new magRecorder(_recordFile, magRecorder::formatOf(_recordFile)));
+    _liveDataSet.clear();
+    if(_online.lambda()!=lambda) _online = magOnlineCalib(lambda);
+    else _online.reset();
+    _liveStats = magStreamStats{0, 0, 0, 0, 0, 0, 0};
+    _liveRows = 0;
+    _liveLatency = -LIVE_STAMP_WINDOW;
+    _liveFrame.resize(LIVE_FRAME_SAMPLES);
+
+    connect(_stream, &magStream::opened, this, [=](QString name)
+    {
+        qInfo()<<name<<"is opened";
+        logMessage(1, QString("%1 is streaming").arg(name));
+    });
+    connect(_stream, &magStream::error, this, [=](QString message)
+    {
+        qWarning()<<message;
+    });
 
+    QVariantMap m;
+    QStringList header;
+    header << "Time" << "raw X" << "raw Y" << "raw Z" << "total";
+    m["headers"] = header;
+    m["realtime"] = true;
+    m["autoscale"] = true;
+    m["history"] = LIVE_PLOT_HISTORY;
+
+    auto p=new qcpPlotView(m, this);
+    auto sub=new customMdiSubWindow(p->widget(), this);
+    ui->mdiArea->addSubWindow(sub);
+    sub->setWindowTitle(QString("Live: %1").arg(_stream->name()));
+    sub->show();
+    _livePlot = p;
 
+    _frameTimer = new QTimer(this);
+    connect(_frameTimer, &QTimer::timeout, this, &MainWindow::streamFrame);
+    _frameTimer->start(LIVE_FRAME_MS);
+    _liveTimer.start();
+
+    _stream->start();
+}
+
+void MainWindow::streamFrame()
+{
+    streamTake(LIVE_FRAME_BUDGET);
+
+    const qint64 ms=_liveTimer.elapsed();
+    if(ms<LIVE_STATS_MS) return;
+    _liveTimer.restart();
+
+    const magStreamStats s=_stream->stats();
+    const double sec=ms*1e-3;
+    QString text=QString("%1: %2 samples/s, %3 kB/s").arg(_stream->name())
+                     .arg((s.samples-_liveStats.samples)/sec, 0, 'f', 0)
+                     .arg((s.bytes-_liveStats.bytes)/sec*1e-3, 0, 'f', 1);
+    if(s.rejected) text += QString(", %1 rejected").arg(s.rejected);
+    if(s.overruns) text += QString(", %1 overruns").arg(s.overruns);
+    if(s.dropped) text += QString(", %1 dropped").arg(s.dropped);
+    if(s.reconnects) text += QString(", %1 reconnects").arg(s.reconnects);
+    if(s.gaps) text += QString(", %1 frames lost").arg(s.gaps);
+    if(const magRecorder *r=_stream->recorder())
+    {
+        text += QString(", recording %1 MB, backlog %2").arg(r->bytes()*1e-6, 0, 'f', 1).arg(r->backlog());
+        if(r->lost()) text += QString(", %1 not recorded").arg(r->lost());
+    }
+    if(_liveLatency>-LIVE_STAMP_WINDOW) text += QString(", latency max %1 ms").arg(_liveLatency*1e3, 0, 'f', 1);
+    _liveLatency = -LIVE_STAMP_WINDOW;
+    _liveStats = s;
+
+    // closed-form fit of everything seen so far, residual of the samples since the last update,
+    // taken by index: text rows are appended in arrival order, which need not be time order
+    const magDataSpan r=_liveDataSet.span().mid(_liveRows, _liveDataSet.size()-_liveRows);
+    _liveRows = _liveDataSet.size();
+    QVector<double> k;
+    if(!r.empty() && _online.estimate(_model, k))
+    {
+        magModelDispatch(_model, [&](auto m)
+        {
+            text += QString(", online fit rms %1").arg(magModelRms<decltype(m)>(k.constData(), r.x, r.y, r.z, r.size()), 0, 'g', 4);
+        });
     }
+    logMessage(1, text);
 }
 
-void MainWindow::loaded(QList<QList<double> > &dataSet)
+// at most budget samples, a burst is spread over several frames and the GUI
+// stays responsive, the stream threads count what does not fit in the rings
+size_t MainWindow::streamTake(size_t budget)
 {
-    _norDataSet.clear();
+    QVector<QVector<double> > columns(5);
+    const double wall=QDateTime::currentMSecsSinceEpoch()*1e-3;
+    size_t total=0;
+    size_t n;
+    while(total<budget && (n=_stream->take(_liveFrame.data(), std::min(_liveFrame.size(), budget-total)))>0)
     {
-        QVariantMap  m;
+        total += n;
+        for(size_t i=0;i<n;i++)
+        {
+            const magStreamSample &s=_liveFrame[i];
+            if(s.sensor!=0) continue;
+            const double age=wall-s.t;
+            if(std::abs(age)<LIVE_STAMP_WINDOW) _liveLatency = std::max(_liveLatency, age);
+            if(_liveDataSet.empty()) _liveDataSet.setTimeBase(s.t);
+            const double t=s.t-_liveDataSet.timeBase();
+            _liveDataSet.append(t, s.x, s.y, s.z);
+            _online.add(t, s.x, s.y, s.z);
+
+            columns[0].append(t);
+            columns[1].append(s.x);
+            columns[2].append(s.y);
+            columns[3].append(s.z);
+            columns[4].append(_liveDataSet.w()[_liveDataSet.size()-1]);
+        }
+    }
+    if(_livePlot && !columns[0].isEmpty()) _livePlot->addColumns(columns);
+    return total;
+}
 
+void MainWindow::stopStream()
+{
+    _frameTimer->stop();
+    _frameTimer->deleteLater();
+    _frameTimer = nullptr;
+
+    _stream->stop();
+    while(streamTake(LIVE_FRAME_BUDGET)>0);     // samples parsed after the last frame
+    const magStreamStats s=_stream->stats();
+    qInfo()<<_stream->name()<<"is closed,"<<s.samples<<"samples,"<<s.bytes<<"bytes,"<<s.rejected<<"rejected,"<<s.dropped<<"dropped";
+    delete _stream;
+    _stream = nullptr;
+    updateCancel();
+
+    // the recording is calibrated like a loaded log
+    if(_liveDataSet.size()<=50)
+    {
+        qWarning()<<"Not enough data";
+    }
+    else if(_solver!=nullptr || _loader!=nullptr)
+    {
+        qWarning()<<"The recorded samples are discarded, solving or loading is in progress.";
+    }
+    else
+    {
+        if(!_liveDataSet.isSorted()) _liveDataSet.sortByTime();
+        const QVariantMap plot=rawPlot(_liveDataSet);
+        auto scaled=scaledDataSet(_liveDataSet);
+        loaded(std::move(_liveDataSet), scaled, plot);
+    }
+    _liveDataSet = magDataSet();
+}
+
+// nonlinear solve of the last MAG_ONLINE_HISTORY live samples, seeded by the
+// closed-form fit, in raw units. A few ten thousand samples are solved on the GUI
+// thread, the stream threads keep buffering meanwhile.
+void MainWindow::on_actionRefine_triggered()
+{
+    if(_stream==nullptr) return;
+    streamTake(LIVE_FRAME_BUDGET);
+
+    const size_t n=std::min<size_t>(_liveDataSet.size(), MAG_ONLINE_HISTORY);
+    const magDataSpan r=_liveDataSet.span().mid(_liveDataSet.size()-n, n);
+
+    QVector<double> k0, k;
+    solverOptions options;
+    options.verbose = 0;
+    QElapsedTimer timer;
+    timer.start();
+    if(!_online.estimate(_model, k0) || !_online.refine(_model, k, options))
+    {
+        qWarning()<<"Not enough live samples to refine the online fit";
+        return;
+    }
+
+    magModelDispatch(_model, [&](auto m)
+    {
+        typedef decltype(m) M;
+        logMessage(1, QString("Refined online fit of %1 samples in %2 ms, rms %3 -> %4")
+                          .arg(n).arg(timer.nsecsElapsed()*1e-6, 0, 'f', 1)
+                          .arg(magModelRms<M>(k0.constData(), r.x, r.y, r.z, r.size()), 0, 'g', 4)
+                          .arg(magModelRms<M>(k.constData(), r.x, r.y, r.z, r.size()), 0, 'g', 4));
+    });
+    qInfo()<<"online fit refined," << magModelNames().value(_model) << "model, raw units";
+    for(int i=0;i<k.size();i+=3) qInfo()<<k.mid(i,3);
+}
+
+// the solver shares _norDataSet, a dataset loaded later does not free the samples it reads
+void MainWindow::startSolve(double t0, double t1, int model, int fastMode, const solverOptions &options)
+{
+    auto solver=new magSolver(_norDataSet, t0, t1, model, fastMode, options);
+    solver->setDataHash(_norHash);
+    _solver = solver;
+
+    if(!fastMode)
+    {
+        QVariantMap m;
         QStringList header;
-        header << "Time" << "raw X" << "raw Y" << "raw Z" << "total";
+        header << "Iteration" << "cost" << "gradient norm";
         m["headers"] = header;
+        m["realtime"] = true;
+        m["autoscale"] = true;
+        m["y_log"] = true;
+
+        auto p=new qcpPlotView(m, this);
+        auto sub=new customMdiSubWindow(p->widget(), this);
+        ui->mdiArea->addSubWindow(sub);
+        sub->setWindowTitle(QString("Convergence (%1)").arg(magModelNames().value(model)));
+        sub->show();
 
-        QVector<double> t,x,y,z,w;
-        double time=-1.0, sum=0.0;
-        for(const auto &i:dataSet)
+        connect(solver, &magSolver::iteration, p, [=](int iteration, double cost, double gradientNorm)
         {
-            if(i.size()==3)
-            {
-                time +=1.0;
-                t.append(time);
-                x.append(i.at(0));
-                y.append(i.at(1));
-                z.append(i.at(2));
-            }
-            else
+            QVector<double> data;
+            data << iteration << cost << gradientNorm;
+            p->addData(data);
+            logMessage(1, QString("Solving ... iteration %1, cost %2").arg(iteration).arg(cost));
+        });
+    }
+
+    runSolver(solver);
+}
+
+void MainWindow::startSweep(double t0, double t1, double width, double stride, int model, const solverOptions &options)
+{
+    auto solver=new magSolver(_norDataSet, t0, t1, model, 0, options);
+    solver->setSweep(width, stride);
+    _solver = solver;
+
+    connect(solver, &magSolver::progress, this, [=](quint64 current, quint64 total)
+    {
+        logMessage(1, QString("Sliding window calibration ... %1 / %2").arg(current).arg(total));
+    });
+
+    runSolver(solver);
+}
+
+void MainWindow::startResample(double t0, double t1, int mode, int count, int model, const solverOptions &options)
+{
+    auto solver=new magSolver(_norDataSet, t0, t1, model, 0, options);
+    solver->setResample(mode, count);
+    _solver = solver;
+
+    connect(solver, &magSolver::progress, this, [=](quint64 current, quint64 total)
+    {
+        logMessage(1, QString("%1 ... %2 / %3").arg(solverResample::modeNames().value(mode)).arg(current).arg(total));
+    });
+
+    runSolver(solver);
+}
+
+void MainWindow::runSolver(magSolver *solver)
+{
+    connect(solver, &magSolver::done, this, [=](QObject *)
+    {
+        _solver = nullptr;
+        updateCancel();
+        if(solver->dataHash()) _norHash = solver->dataHash();     // no dataset is loaded while solving
+        if(!solver->result())
+        {
+            qWarning()<<"Calibration parameters are not solved.";
+        }
+        else if(solver->isSweep())
+        {
+            plotSweep(solver->windows(), solver->model());
+        }
+        else if(solver->isResample())
+        {
+            const solverResample &r=solver->resample();
+            qInfo()<<solverResample::modeNames().value(r.mode)<<"mean, sigma and 95% interval of the parameters:";
+            for(int i=0;i<r.mean.size();i++)
             {
-                if(time<0.0) time = i.at(0);
-                t.append(i.at(0)-time);
-                x.append(i.at(1));
-                y.append(i.at(2));
-                z.append(i.at(3));
+                qInfo()<<QString("k[%1] %2 +- %3 [%4, %5]").arg(i).arg(r.mean[i],0,'g',8).arg(r.sigma[i],0,'g',3).arg(r.lower[i],0,'g',8).arg(r.upper[i],0,'g',8);
             }
-            QList<double> n;
-            auto w_=std::sqrt(x.back()*x.back() + y.back()*y.back() + z.back()*z.back());
-            n << t.back() << x.back() << y.back() << z.back();
-            _norDataSet.append(n);
-            sum += w_;
-            w.append(w_);
+            qInfo()<<"Residual rms, in-sample"<<r.inSampleRms<<"out-of-sample"<<r.outOfSampleRms<<"+-"<<r.outOfSampleRmsSigma;
+            solved(r.k, solver->model(), r.toVariant());
         }
-
-        if(t.size()>16)
+        else
         {
-            double scale=t.size()/sum;
-            qInfo()<<"Preliminary scale factor is" << scale;
-            for(int i=0;i<t.size();i++)
+            const solverReport &r=solver->report();
+            if(!r.inlierMask.empty()) plotInliers(solver->t0(), solver->t1(), r.inlierMask);
+            QVariantMap uncertainty;
+            if(!r.covariance.isEmpty())
             {
-                QList<double> n;
-                n << t.at(i) << x.at(i) * scale << y.at(i) * scale << z.at(i) * scale;
-                _scaDataSet.append(n);
+                const QVariantMap m=r.toVariant();
+                uncertainty["covariance"] = m["covariance"];
+                uncertainty["sigma"] = m["sigma"];
+                qInfo()<<"Parameter sigma"<<r.sigma();
             }
+            solved(solver->k(), solver->model(), uncertainty);
+        }
+        solver->thread()->quit();
+    });
 
-            QVariantList columns;
-            columns.append(QVariant::fromValue(t));
-            columns.append(QVariant::fromValue(x));
-            columns.append(QVariant::fromValue(y));
-            columns.append(QVariant::fromValue(z));
-            columns.append(QVariant::fromValue(w));
-            m["columns"] = columns;
-            m["realtime"] = false;
-
-            auto p=new qcpPlotView(m, this);
-            auto sub=new customMdiSubWindow(p->widget(), this);
-            ui->mdiArea->addSubWindow(sub);
-            sub->setWindowTitle("Raw Data");
-            sub->show();
+    QThread *x=new QThread;
+    connect(x, &QThread::finished, solver, &QObject::deleteLater);
+    connect(x, &QThread::finished, x, &QObject::deleteLater);
+    solver->moveToThread(x);
+    x->start();
+    updateCancel();
 
-            {
-                QByteArray dummy;
-                dummy.append((char)0);
-                _glWidget->delayLoad(new gl_mag_entity("raw data",_scaDataSet), dummy);
-            }
-        }
-    }
+    QMetaObject::invokeMethod(solver, "run");
 }
 
+void MainWindow::solved(const QVector<double> &k, int model, const QVariantMap &uncertainty)
+{
+    qInfo()<<"calibration parameters are solved," << magModelNames().value(model) << "model";
+    for(int i=0;i<k.size();i+=3) qInfo()<<k.mid(i,3);
+    _k = k;
+    _model = model;
+    _uncertainty = uncertainty;
+    plotCor(_k, _model);
+}
 
-int MainWindow::solve(double t0, double t1, QVector<double> &k, int verbose)
+// raw data in the 3D view colored by the RANSAC mask of the samples in t0<t<t1
+void MainWindow::plotInliers(double t0, double t1, const std::vector<uint8_t> &inliers)
 {
-    extern int solve(QList<QList<double> > &dataSet, double t0, double t1, QVector<double> &k);
+    const magDataSpan r=_norDataSet->range(t0, t1);
+    if(r.size()!=inliers.size() || !_scaDataSet) return;
+
+    auto mask=std::make_shared<std::vector<uint8_t> >(_norDataSet->size(), 0);
+    const size_t offset=r.t-_norDataSet->t();
+    for(size_t i=0;i<inliers.size();i++) (*mask)[offset+i] = inliers[i] ? 2 : 1;
 
-    if(solve(_norDataSet,t0,t1, k))
+    const size_t n=inliers.size();
+    const size_t nIn=std::count(inliers.begin(), inliers.end(), 1);
+    qInfo() << nIn << "inliers," << n-nIn << "outliers";
+
+    QByteArray dummy;
+    dummy.append((char)0);
+    _glWidget->delayLoad(new gl_mag_entity("inliers", _scaDataSet, mask), dummy);
+}
+
+// parameters of every window at the window center
+void MainWindow::plotSweep(const std::vector<solverWindow> &windows, int model)
+{
+    const int nParams=magModelParams(model);
+    QVector<double> t;
+    QVector<QVector<double> > k(nParams);
+    size_t failed=0;
+    for(const auto &w:windows)
     {
-        if(verbose)
+        if(!w.result || w.k.size()!=nParams)
         {
-            qInfo()<<"calibration parameters are solved";
-            qInfo()<<"x"<<k[0]<<k[1]<<k[2];
-            qInfo()<<"y"<<k[3]<<k[4]<<k[5];
-            qInfo()<<"z"<<k[6]<<k[7]<<k[8];
+            failed++;
+            continue;
         }
-        _k = k;
-        return 1;
+        t.append(0.5*(w.t0+w.t1));
+        for(int i=0;i<nParams;i++) k[i].append(w.k[i]);
     }
-    return 0;
+    if(failed) qWarning()<<failed<<"of"<<windows.size()<<"windows are not solved.";
+    if(t.isEmpty()) return;
+
+    QVariantMap m;
+    QStringList header;
+    header << "Time";
+    QVariantList columns;
+    columns.append(QVariant::fromValue(t));
+    for(int i=0;i<nParams;i++)
+    {
+        header << QString("k[%1]").arg(i);
+        columns.append(QVariant::fromValue(k[i]));
+    }
+    m["headers"] = header;
+    m["columns"] = columns;
+    m["realtime"] = false;
+
+    auto p=new qcpPlotView(m, this);
+    auto sub=new customMdiSubWindow(p->widget(), this);
+    ui->mdiArea->addSubWindow(sub);
+    sub->setWindowTitle(QString("Sliding window (%1)").arg(magModelNames().value(model)));
+    sub->show();
 }
 
-void MainWindow::plotCor(QVector<double> &k)
+void MainWindow::plotCor(const QVector<double> &k, int model)
 {
     QVariantMap  m;
     QStringList header;
     header << "Time" << "cor X" << "cor Y" << "cor Z" << "total";
     m["headers"] = header;
-    _corDataSet.clear();
-    QVector<double> t,x,y,z,w;
-    double time=-1.0;
-    for(const auto &i:_norDataSet)
-    {
-        if(time<0.0) time = i.at(0);
-        t.append(i.at(0)-time);
-        x.append(k[0]*i.at(1)*i.at(1) +k[1]*i.at(1) +k[2]);
-        y.append(k[3]*i.at(2)*i.at(2) +k[4]*i.at(2) +k[5]);
-        z.append(k[6]*i.at(3)*i.at(3) +k[7]*i.at(3) +k[8]);
-        w.append(std::sqrt(x.back()*x.back() + y.back()*y.back() + z.back()*z.back()));
 
-        QList<double> n;
-        n <<t.back()<<x.back()<<y.back()<<z.back()<<w.back();
-        _corDataSet.append(n);
-    }
+    auto cor=std::make_shared<magDataSet>();
+    magApply(model, k.constData(), *_norDataSet, *cor);
+#ifdef APPLY_BENCHMARK
+    magApplyBenchmark(model, k.constData(), _norDataSet->span());
+#endif
+    _corDataSet = cor;
 
-    QVariantList columns;
-    columns.append(QVariant::fromValue(t));
-    columns.append(QVariant::fromValue(x));
-    columns.append(QVariant::fromValue(y));
-    columns.append(QVariant::fromValue(z));
-    columns.append(QVariant::fromValue(w));
-    m["columns"] = columns;
+    m["columns"] = toColumns(*cor);
     m["realtime"] = false;
 
     auto p=new qcpPlotView(m, this);
@@ -706,7 +1163,19 @@ void MainWindow::plotCor(QVector<double> &k)
 
 void MainWindow::on_actionExecute_triggered()
 {
-    calibOptionsDialog dlg(_norDataSet.front().front(), _norDataSet.back().front(), this);
+    if(!_norDataSet || _norDataSet->empty()) return;
+    if(_loader!=nullptr)
+    {
+        qWarning()<<"Loading"<<_loader->fileName()<<"is in progress.";
+        return;
+    }
+    if(_solver!=nullptr)
+    {
+        qWarning()<<"Solving is in progress.";
+        return;
+    }
+
+    calibOptionsDialog dlg(_norDataSet->front(), _norDataSet->back(), this);
     if(dlg.exec()==QDialog::Accepted)
     {
         auto p=dlg.params();
@@ -714,11 +1183,12 @@ void MainWindow::on_actionExecute_triggered()
         {
             double t0=p["t0"].toDouble();
             double t1=p["t1"].toDouble();
-            QVector<double> k;
-            if(solve(t0,t1,k))
-            {
-                plotCor(k);
-            }
+            int model=p["model"].toInt();
+            int fast=p["fast"].toBool() ? 1 : 0;
+            auto options=solverOptions::fromVariant(p["solver"].toMap());
+            if(p.contains("width")) startSweep(t0,t1,p["width"].toDouble(),p["stride"].toDouble(),model,options);
+            else if(p.contains("resample")) startResample(t0,t1,p["resample"].toInt(),p["count"].toInt(),model,options);
+            else startSolve(t0,t1,model,fast,options);
         }
         else
         {
@@ -741,16 +1211,9 @@ void MainWindow::on_actionExport_triggered()
         if(f.open(QFile::WriteOnly|QFile::Text))
         {
             QTextStream t(&f);
-            QVariantMap m;
-            QVariantList x,y,z;
-            x << _k[0] << _k[1] << _k[2];
-            y << _k[3] << _k[4] << _k[5];
-            z << _k[6] << _k[7] << _k[8];
+            QVariantMap m=magModelToVariant(_model, _k.constData());
             m["date"] = QDateTime::currentDateTimeUtc().toString();
-            m["model"] = "cor = k[0] x raw^2 + k[1] x raw + k[2]";
-            m["kx"] = x;
-            m["ky"] = y;
-            m["kz"] = z;
+            if(!_uncertainty.isEmpty()) m["uncertainty"] = _uncertainty;
             QJsonDocument j(QJsonObject::fromVariantMap(m));
             t << j.toJson();
             f.close();
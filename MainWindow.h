@@ -27,9 +27,20 @@ SOFTWARE.
 
 
 #include <QMainWindow>
+#include <QVariantMap>
+#include <QElapsedTimer>
+#include <QPointer>
 
 #include <Qlist>
 
+#include <cstdint>
+#include <memory>
+
+#include "magDataSet.h"
+#include "magOnlineCalib.h"
+#include "magStream.h"
+#include "solver.h"
+
 QT_BEGIN_NAMESPACE
 namespace Ui { class MainWindow; }
 QT_END_NAMESPACE
@@ -43,6 +54,10 @@ class QMdiSubWindow;
 class customGLWidget;
 class customMdiSubWindow;
 class gl_entity_ctx;
+class magLoader;
+class magSolver;
+class qcpPlotView;
+class QTimer;
 
 class MainWindow : public QMainWindow
 {
@@ -82,6 +97,10 @@ private slots:
 
     void on_actionTCP_Client_triggered();
 
+    void on_actionRecord_triggered(bool checked);
+
+    void on_actionRefine_triggered();
+
 #ifdef USE_MAP_VIEW
     void on_actionMap_View_triggered();
 #endif
@@ -92,6 +111,8 @@ private slots:
 
     void on_actionExport_triggered();
 
+    void on_actionCancel_triggered();
+
 private:
 
 #ifdef USE_PLOT_VIEW
@@ -105,9 +126,20 @@ private:
 #endif
 #endif
 
-    void loaded(QList<QList<double> > &dataSet);
-    int solve(double t0, double t1, QVector<double> &k, int verbose=1);
-    void plotCor(QVector<double> &k);
+    void loaded(magDataSet &&dataSet, std::shared_ptr<const magDataSet> scaled, const QVariantMap &plot);
+    void startSolve(double t0, double t1, int model, int fastMode, const solverOptions &options);
+    void startSweep(double t0, double t1, double width, double stride, int model, const solverOptions &options);
+    void startResample(double t0, double t1, int mode, int count, int model, const solverOptions &options);
+    void runSolver(magSolver *solver);
+    void solved(const QVector<double> &k, int model, const QVariantMap &uncertainty=QVariantMap());
+    void plotSweep(const std::vector<solverWindow> &windows, int model);
+    void plotInliers(double t0, double t1, const std::vector<uint8_t> &inliers);
+    void plotCor(const QVector<double> &k, int model);
+    void startStream(magStreamSource *source, int framing=MAG_STREAM_FRAMING_NEWLINE, double lambda=1.0);
+    void streamFrame(void);
+    size_t streamTake(size_t budget);
+    void stopStream(void);
+    void updateCancel(void);
 
 private:
     Ui::MainWindow *ui;
@@ -125,9 +157,27 @@ private:
     customMapView *_mapWidget;
 #endif
 
-    QList<QList<double> > _norDataSet;  // normalized (time,x,y,z,w)
-    QList<QList<double> > _scaDataSet;  // scaled (time,x,y,z,w)
-    QList<QList<double> > _corDataSet;  // corrected (time,x,y,z,w)
+    magLoader *_loader;                                 // background loading job
+    magSolver *_solver;                                 // background solving job
+    magStream *_stream;                                 // live acquisition
+    QString _recordFile;                                // live streams are recorded to this file, empty: off
+
+    magDataSet _liveDataSet;                            // samples of sensor 0 while streaming
+    magOnlineCalib _online;                             // closed-form fit of _liveDataSet
+    std::vector<magStreamSample> _liveFrame;            // taken from the sample ring
+    magStreamStats _liveStats;                          // at the last status update
+    size_t _liveRows;                                   // size of _liveDataSet at the last status update
+    double _liveLatency;                                // max wall clock - time stamp since the last status update, stamped streams only
+    QElapsedTimer _liveTimer;
+    QTimer *_frameTimer;
+    QPointer<qcpPlotView> _livePlot;
+
+    std::shared_ptr<const magDataSet> _norDataSet;      // normalized (time,x,y,z,w), shared with the solver
+    uint64_t _norHash;                                  // result cache hash of _norDataSet, 0: not hashed yet
+    std::shared_ptr<const magDataSet> _scaDataSet;      // scaled (time,x,y,z,w), shared with 3D view
+    std::shared_ptr<const magDataSet> _corDataSet;      // corrected (time,x,y,z,w), shared with 3D view
     QVector<double> _k;
+    int _model;                                         // model of _k, index in magModels
+    QVariantMap _uncertainty;                           // covariance or resampling statistics of _k
 };
 #endif // MAINWINDOW_H
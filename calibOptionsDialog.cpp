@@ -1,6 +1,13 @@
 #include "calibOptionsDialog.h"
 #include "ui_calibOptionsDialog.h"
 
+#include <QDebug>
+
+#include "configStorage.h"
+#include "magModel.h"
+#include "solver.h"
+#include "solverResample.h"
+
 calibOptionsDialog::calibOptionsDialog(double t0, double t1, QWidget *parent) :
     QDialog(parent),
     ui(new Ui::calibOptionsDialog)
@@ -11,7 +18,18 @@ calibOptionsDialog::calibOptionsDialog(double t0, double t1, QWidget *parent) :
     ui->setupUi(this);
     ui->leStart->setText(QString("%1").arg(t0,3,'f'));
     ui->leEnd->setText(QString("%1").arg(t1,3,'f'));
+    ui->leWidth->setText(QString("%1").arg((t1-t0)/10.0,3,'f'));
+    ui->leStride->setText(QString("%1").arg((t1-t0)/100.0,3,'f'));
+    ui->cbModel->addItems(magModelNames());
+    ui->cbLinearSolver->addItems(solverOptions::linearSolverNames());
+    ui->cbTrustRegion->addItems(solverOptions::trustRegionNames());
+    ui->cbResampleMode->addItems(solverResample::modeNames());
+
+    // one of sliding window or resampling
+    connect(ui->gbSweep, &QGroupBox::toggled, this, [=](bool on){if(on) ui->gbResample->setChecked(false);});
+    connect(ui->gbResample, &QGroupBox::toggled, this, [=](bool on){if(on) ui->gbSweep->setChecked(false);});
     _params.clear();
+    load();
 }
 
 calibOptionsDialog::~calibOptionsDialog()
@@ -29,14 +47,71 @@ void calibOptionsDialog::on_buttonBox_accepted()
         QVariantMap p;
         p["t0"] = t0;
         p["t1"] = t1;
-        if(t0<t1 && _t0<=t0 && t1<=_t1)
+        p["model"] = ui->cbModel->currentIndex();
+        p["fast"] = ui->cbFast->isChecked();
+
+        solverOptions o;
+        o.threads = ui->sbThreads->value();
+        o.linearSolver = ui->cbLinearSolver->currentIndex();
+        o.trustRegion = ui->cbTrustRegion->currentIndex();
+        o.maxIterations = ui->sbMaxIterations->value();
+        o.cellSamples = ui->sbCellSamples->value();
+        o.covariance = ui->cbCovariance->isChecked() ? 1 : 0;
+        o.robust = ui->cbRobust->isChecked() ? 1 : 0;
+        o.robustThreshold = ui->dsbRobustThreshold->value()*0.01;
+        p["solver"] = o.toVariant();
+
+        bool ok3=true,ok4=true;
+        if(ui->gbSweep->isChecked())
+        {
+            double width=ui->leWidth->text().toDouble(&ok3);
+            double stride=ui->leStride->text().toDouble(&ok4);
+            if(ok3 && ok4 && solveSweepWindows(t0, t1, width, stride)>0)
+            {
+                p["width"] = width;
+                p["stride"] = stride;
+            }
+            else
+            {
+                qWarning()<<"Sliding windows: width must fit the time range, at most"<<SOLVER_SWEEP_MAX_WINDOWS<<"windows";
+                ok3 = false;
+            }
+        }
+        else if(ui->gbResample->isChecked())
+        {
+            p["resample"] = ui->cbResampleMode->currentIndex();
+            p["count"] = ui->sbResampleCount->value();
+        }
+
+        if(ok3 && ok4 && t0<t1 && _t0<=t0 && t1<=_t1)
         {
             _params=p;
+            save();
         }
     }
     QDialog::accept();
 }
 
+void calibOptionsDialog::load(void)
+{
+    configStorage s("solver", this);
+    auto o=solverOptions::fromVariant(s.load("options"));
+    ui->sbThreads->setValue(o.threads);
+    ui->cbLinearSolver->setCurrentIndex(o.linearSolver);
+    ui->cbTrustRegion->setCurrentIndex(o.trustRegion);
+    ui->sbMaxIterations->setValue(o.maxIterations);
+    ui->sbCellSamples->setValue(o.cellSamples);
+    ui->cbCovariance->setChecked(o.covariance!=0);
+    ui->cbRobust->setChecked(o.robust!=0);
+    ui->dsbRobustThreshold->setValue(o.robustThreshold*100.0);
+}
+
+void calibOptionsDialog::save(void)
+{
+    configStorage s("solver", this);
+    s.save(_params["solver"].toMap(),"options");
+}
+
 const QVariantMap &calibOptionsDialog::params() const
 {
     return _params;
@@ -23,6 +23,10 @@ private slots:
 
     void on_buttonBox_rejected();
 
+private:
+    void load(void);
+    void save(void);
+
 private:
     Ui::calibOptionsDialog *ui;
     double _t0;
@@ -0,0 +1,171 @@
+/*
+MIT License
+
+Copyright (c) 2021 WagonWheelRobotics
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#include "ellipsoidFit.h"
+
+#include <Eigen/Dense>
+
+#include <cmath>
+#include <vector>
+
+#include "parallel.h"
+
+#define ELLIPSOID_FIT_CHUNK     65536
+
+ellipsoidFit::ellipsoidFit(double scale)
+{
+    _scale = scale;
+    clear();
+}
+
+void ellipsoidFit::clear(void)
+{
+    _S.setZero();
+    _n = 0.0;
+    _c.setZero();
+    _W.setIdentity();
+}
+
+void ellipsoidFit::initScale(double x, double y, double z)
+{
+    if(_scale<=0.0)
+    {
+        _scale = std::sqrt(x*x + y*y + z*z);
+        if(!(_scale>0.0)) _scale = 1.0;
+    }
+}
+
+void ellipsoidFit::add(double x, double y, double z, double weight)
+{
+    initScale(x,y,z);
+    const double inv=1.0/_scale;
+    x *= inv;
+    y *= inv;
+    z *= inv;
+
+    const double d[10]={x*x, y*y, z*z, 2.0*x*y, 2.0*x*z, 2.0*y*z, 2.0*x, 2.0*y, 2.0*z, 1.0};
+    for(int i=0;i<10;i++)
+    {
+        const double wd=weight*d[i];
+        for(int j=i;j<10;j++) _S(i,j) += wd*d[j];    // upper triangle only
+    }
+    _n += 1.0;
+}
+
+void ellipsoidFit::add(const magDataSpan &data, int threads)
+{
+    if(data.empty()) return;
+    initScale(data.x[0], data.y[0], data.z[0]);
+
+    const size_t nChunk=(data.size()+ELLIPSOID_FIT_CHUNK-1)/ELLIPSOID_FIT_CHUNK;
+    std::vector<ellipsoidFit> part(nChunk, ellipsoidFit(_scale));
+    parallel::forEach(nChunk, [&](size_t c, int)
+    {
+        const magDataSpan d=data.mid(c*ELLIPSOID_FIT_CHUNK, ELLIPSOID_FIT_CHUNK);
+        for(size_t i=0;i<d.size();i++) part[c].add(d.x[i], d.y[i], d.z[i]);
+    }, threads);
+
+    for(const auto &p:part) merge(p);
+}
+
+// scatter matrices in a different scale are converted, d' = D*d
+void ellipsoidFit::merge(const ellipsoidFit &o)
+{
+    if(o._n<=0.0) return;
+    if(_n<=0.0 && _scale<=0.0) _scale=o._scale;
+
+    if(o._scale==_scale)
+    {
+        _S += o._S;
+    }
+    else
+    {
+        const double r=o._scale/_scale;
+        Eigen::Matrix<double,10,1> D;
+        D << r*r, r*r, r*r, r*r, r*r, r*r, r, r, r, 1.0;
+        _S += D.asDiagonal() * o._S * D.asDiagonal();
+    }
+    _n += o._n;
+}
+
+void ellipsoidFit::decay(double lambda)
+{
+    _S *= lambda;
+    _n *= lambda;
+}
+
+int ellipsoidFit::solve(void)
+{
+    if(_n<9.0) return 0;   // 9 degrees of freedom, 9 samples in general position define the quadric
+
+    Eigen::Matrix<double,10,10> S=_S.selfadjointView<Eigen::Upper>();
+    Eigen::SelfAdjointEigenSolver<Eigen::Matrix<double,10,10> > es(S);
+    if(es.info()!=Eigen::Success) return 0;
+    const Eigen::Matrix<double,10,1> v=es.eigenvectors().col(0);
+
+    // x^T M x + 2 b^T x + j = 0
+    Eigen::Matrix3d M;
+    M << v(0), v(3), v(4),
+         v(3), v(1), v(5),
+         v(4), v(5), v(2);
+    const Eigen::Vector3d b(v(6), v(7), v(8));
+    const double j=v(9);
+
+    Eigen::FullPivLU<Eigen::Matrix3d> lu(M);
+    if(!lu.isInvertible()) return 0;
+    const Eigen::Vector3d c = -lu.solve(b);
+
+    // (x-c)^T M (x-c) = c^T M c - j
+    const double g = c.dot(M*c) - j;
+    if(g==0.0 || !std::isfinite(g)) return 0;
+    const Eigen::Matrix3d Q = M/g;
+
+    Eigen::SelfAdjointEigenSolver<Eigen::Matrix3d> eq(Q);
+    if(eq.info()!=Eigen::Success || eq.eigenvalues().minCoeff()<=0.0) return 0;
+    const Eigen::Matrix3d W = eq.eigenvectors() * eq.eigenvalues().cwiseSqrt().asDiagonal() * eq.eigenvectors().transpose();
+
+    _c = c*_scale;
+    _W = W/_scale;
+    return 1;
+}
+
+void ellipsoidFit::quadratic(double *k) const
+{
+    for(int i=0;i<3;i++)
+    {
+        k[3*i+0] = 0.0;
+        k[3*i+1] = _W(i,i);
+        k[3*i+2] = -_W(i,i)*_c(i);
+    }
+}
+
+void ellipsoidFit::affine(double *k) const
+{
+    const Eigen::Vector3d o = -_W*_c;
+    for(int i=0;i<3;i++)
+    {
+        for(int j=0;j<3;j++) k[3*i+j] = _W(i,j);
+        k[9+i] = o(i);
+    }
+}
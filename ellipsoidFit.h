@@ -0,0 +1,79 @@
+#ifndef ELLIPSOIDFIT_H
+#define ELLIPSOIDFIT_H
+
+/*
+MIT License
+
+Copyright (c) 2021 WagonWheelRobotics
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#include <Eigen/Core>
+
+#include <cstddef>
+
+#include "magDataSet.h"
+
+// Direct (algebraic) least squares ellipsoid fit
+//
+// Each sample adds d*d^T to a 10x10 scatter matrix,
+//   d = [x^2, y^2, z^2, 2xy, 2xz, 2yz, 2x, 2y, 2z, 1]
+// and the quadric v which minimizes v^T S v (|v|=1) is the eigenvector of the
+// smallest eigenvalue. The accumulation is streaming, O(1) per sample,
+// and two fits can be merged, so partial sums can be built in parallel.
+//
+// The result is written as |W (raw - c)| = 1 with a symmetric soft iron matrix W
+// and a hard iron offset c.
+
+class ellipsoidFit
+{
+public:
+    explicit ellipsoidFit(double scale=0.0);   // scale: typical magnitude, 0 for the first sample
+
+    void clear(void);
+    void add(double x, double y, double z, double weight=1.0);
+    void add(const magDataSpan &data, int threads=0);
+    void merge(const ellipsoidFit &o);
+    void decay(double lambda);          // S = lambda*S and the count, exponential forgetting
+
+    double count() const {return _n;}  // samples, weighted by the forgetting
+    double scale() const {return _scale;}
+
+    int solve(void);    // 1 if the quadric is an ellipsoid
+
+    const Eigen::Vector3d &center() const {return _c;}
+    const Eigen::Matrix3d &softIron() const {return _W;}
+
+    void quadratic(double *k) const;    // 9: per axis model, cor = k0*raw^2 + k1*raw + k2
+    void affine(double *k) const;       // 12: row major W, then -W*c
+
+private:
+    void initScale(double x, double y, double z);
+
+private:
+    Eigen::Matrix<double,10,10> _S;
+    double _scale;
+    double _n;      // decays with _S, 1/(1-lambda) at most
+
+    Eigen::Vector3d _c;
+    Eigen::Matrix3d _W;
+};
+
+#endif // ELLIPSOIDFIT_H
@@ -0,0 +1,245 @@
+/*
+MIT License
+
+Copyright (c) 2021 WagonWheelRobotics
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#include "magApply.h"
+
+#include <QElapsedTimer>
+#include <QDebug>
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+#if defined(__AVX__)
+#include <immintrin.h>
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP>=2)
+#include <emmintrin.h>
+#define MAG_APPLY_SSE2
+#endif
+
+#include "magModel.h"
+#include "parallel.h"
+
+#define MAG_APPLY_CHUNK         65536   // samples per parallel task
+#define MAG_APPLY_BENCH_MS      200     // minimum time of a benchmark run
+
+// a register of doubles with the operators used by the model apply() functions
+#if defined(__AVX__)
+struct magVec
+{
+    enum {N=4};
+    __m256d v;
+
+    magVec() {}
+    magVec(__m256d a) : v(a) {}
+    explicit magVec(double a) : v(_mm256_set1_pd(a)) {}
+
+    static magVec load(const double *p) {return _mm256_loadu_pd(p);}
+    void store(double *p) const {_mm256_storeu_pd(p, v);}
+
+    friend magVec operator+(const magVec &a, const magVec &b) {return _mm256_add_pd(a.v, b.v);}
+    friend magVec operator*(const magVec &a, const magVec &b) {return _mm256_mul_pd(a.v, b.v);}
+    friend magVec sqrt(const magVec &a) {return _mm256_sqrt_pd(a.v);}
+};
+static const char *isa="AVX";
+#elif defined(MAG_APPLY_SSE2)
+struct magVec
+{
+    enum {N=2};
+    __m128d v;
+
+    magVec() {}
+    magVec(__m128d a) : v(a) {}
+    explicit magVec(double a) : v(_mm_set1_pd(a)) {}
+
+    static magVec load(const double *p) {return _mm_loadu_pd(p);}
+    void store(double *p) const {_mm_storeu_pd(p, v);}
+
+    friend magVec operator+(const magVec &a, const magVec &b) {return _mm_add_pd(a.v, b.v);}
+    friend magVec operator*(const magVec &a, const magVec &b) {return _mm_mul_pd(a.v, b.v);}
+    friend magVec sqrt(const magVec &a) {return _mm_sqrt_pd(a.v);}
+};
+static const char *isa="SSE2";
+#else
+struct magVec
+{
+    enum {N=1};
+    double v;
+
+    magVec() {}
+    explicit magVec(double a) : v(a) {}
+
+    static magVec load(const double *p) {return magVec(*p);}
+    void store(double *p) const {*p = v;}
+
+    friend magVec operator+(const magVec &a, const magVec &b) {return magVec(a.v + b.v);}
+    friend magVec operator*(const magVec &a, const magVec &b) {return magVec(a.v * b.v);}
+    friend magVec sqrt(const magVec &a) {return magVec(std::sqrt(a.v));}
+};
+static const char *isa="scalar";
+#endif
+
+template <class M>
+static void applyBlock(const double *k, const double *x, const double *y, const double *z, size_t n,
+                       double *cx, double *cy, double *cz, double *cw)
+{
+    magVec kv[M::nParams];
+    for(int j=0;j<M::nParams;j++) kv[j] = magVec(k[j]);
+
+    size_t i=0;
+    for(;i+magVec::N<=n;i+=magVec::N)
+    {
+        const magVec X=magVec::load(x+i), Y=magVec::load(y+i), Z=magVec::load(z+i);
+        magVec CX, CY, CZ;
+        M::apply(kv, X, Y, Z, CX, CY, CZ);
+        CX.store(cx+i);
+        CY.store(cy+i);
+        CZ.store(cz+i);
+        sqrt(CX*CX + CY*CY + CZ*CZ).store(cw+i);
+    }
+    for(;i<n;i++)
+    {
+        M::apply(k, x[i], y[i], z[i], cx[i], cy[i], cz[i]);
+        cw[i] = std::sqrt(cx[i]*cx[i] + cy[i]*cy[i] + cz[i]*cz[i]);
+    }
+}
+
+template <class M>
+static size_t inlierBlock(const double *k, const double *x, const double *y, const double *z, size_t n, double threshold, uint8_t *mask)
+{
+    magVec kv[M::nParams];
+    for(int j=0;j<M::nParams;j++) kv[j] = magVec(k[j]);
+
+    size_t count=0;
+    auto test=[&](size_t i, double w)
+    {
+        const bool in=std::abs(w-1.0)<=threshold;
+        if(mask!=nullptr) mask[i] = in ? 1 : 0;
+        count += in ? 1 : 0;
+    };
+
+    size_t i=0;
+    for(;i+magVec::N<=n;i+=magVec::N)
+    {
+        const magVec X=magVec::load(x+i), Y=magVec::load(y+i), Z=magVec::load(z+i);
+        magVec CX, CY, CZ;
+        M::apply(kv, X, Y, Z, CX, CY, CZ);
+        double w[magVec::N];
+        sqrt(CX*CX + CY*CY + CZ*CZ).store(w);
+        for(int j=0;j<magVec::N;j++) test(i+j, w[j]);
+    }
+    for(;i<n;i++)
+    {
+        double cx, cy, cz;
+        M::apply(k, x[i], y[i], z[i], cx, cy, cz);
+        test(i, std::sqrt(cx*cx + cy*cy + cz*cz));
+    }
+    return count;
+}
+
+int magApply(int model, const double *k, const magDataSpan &raw, double *cx, double *cy, double *cz, double *cw, int threads)
+{
+    const size_t n=raw.size();
+    const size_t nChunk=(n+MAG_APPLY_CHUNK-1)/MAG_APPLY_CHUNK;
+    return magModelDispatch(model, [&](auto m)
+    {
+        parallel::forEach(nChunk, [&](size_t c, int)
+        {
+            const size_t pos=c*MAG_APPLY_CHUNK;
+            const size_t len=std::min<size_t>(MAG_APPLY_CHUNK, n-pos);
+            applyBlock<decltype(m)>(k, raw.x+pos, raw.y+pos, raw.z+pos, len, cx+pos, cy+pos, cz+pos, cw+pos);
+        }, threads);
+    });
+}
+
+int magApply(int model, const double *k, const magDataSet &raw, magDataSet &cor, int threads)
+{
+    const size_t n=raw.size();
+    cor.resize(n);
+    cor.setTimeBase(raw.timeBase());
+    std::copy(raw.t(), raw.t()+n, cor.t());
+    return magApply(model, k, raw.span(), cor.x(), cor.y(), cor.z(), cor.w(), threads);
+}
+
+size_t magApplyInliers(int model, const double *k, const magDataSpan &raw, double threshold, uint8_t *mask, int threads)
+{
+    const size_t n=raw.size();
+    const size_t nChunk=(n+MAG_APPLY_CHUNK-1)/MAG_APPLY_CHUNK;
+    std::vector<size_t> count(nChunk, 0);
+    magModelDispatch(model, [&](auto m)
+    {
+        parallel::forEach(nChunk, [&](size_t c, int)
+        {
+            const size_t pos=c*MAG_APPLY_CHUNK;
+            const size_t len=std::min<size_t>(MAG_APPLY_CHUNK, n-pos);
+            count[c] = inlierBlock<decltype(m)>(k, raw.x+pos, raw.y+pos, raw.z+pos, len, threshold, mask!=nullptr ? mask+pos : nullptr);
+        }, threads);
+    });
+
+    size_t total=0;
+    for(auto c:count) total += c;
+    return total;
+}
+
+const char *magApplyIsa(void)
+{
+    return isa;
+}
+
+// repeats f for at least MAG_APPLY_BENCH_MS, returns GB/s
+template <typename F> static double throughput(size_t n, F f)
+{
+    QElapsedTimer timer;
+    timer.start();
+    int runs=0;
+    do
+    {
+        f();
+        runs++;
+    } while(timer.elapsed()<MAG_APPLY_BENCH_MS);
+    return (double)n*7.0*sizeof(double)*runs/(timer.nsecsElapsed()*1e-9)*1e-9;
+}
+
+void magApplyBenchmark(int model, const double *k, const magDataSpan &raw)
+{
+    const size_t n=raw.size();
+    if(n==0) return;
+    magColumn cx(n), cy(n), cz(n), cw(n);
+
+    double ref=0.0;
+    magModelDispatch(model, [&](auto m)
+    {
+        ref = throughput(n, [&]
+        {
+            magModelApply<decltype(m)>(k, raw.x, raw.y, raw.z, n, cx.data(), cy.data(), cz.data());
+            for(size_t i=0;i<n;i++) cw[i] = std::sqrt(cx[i]*cx[i] + cy[i]*cy[i] + cz[i]*cz[i]);
+        });
+    });
+    const double single=throughput(n, [&]{magApply(model, k, raw, cx.data(), cy.data(), cz.data(), cw.data(), 1);});
+    const double all=throughput(n, [&]{magApply(model, k, raw, cx.data(), cy.data(), cz.data(), cw.data(), 0);});
+
+    qInfo() << "Apply kernel" << magModelNames().value(model) << isa << n << "samples:"
+            << "reference" << ref << "GB/s, kernel" << single << "GB/s, kernel"
+            << parallel::threads() << "threads" << all << "GB/s";
+}
@@ -0,0 +1,54 @@
+#ifndef MAGAPPLY_H
+#define MAGAPPLY_H
+
+/*
+MIT License
+
+Copyright (c) 2021 WagonWheelRobotics
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#include <cstddef>
+#include <cstdint>
+
+#include "magDataSet.h"
+
+// Calibration apply kernel
+//
+// cor = model(raw) and w = |cor| in one pass over contiguous x,y,z columns into
+// preallocated output columns. The samples are processed in SIMD registers
+// (AVX when the compiler targets it, SSE2 on x86-64, scalar otherwise) through
+// the templated apply() of the model, so every model of magModels is vectorized
+// without a kernel of its own. Chunks of the columns are processed in parallel.
+
+// returns 0 for an unknown model
+int magApply(int model, const double *k, const magDataSpan &raw, double *cx, double *cy, double *cz, double *cw, int threads=0);
+int magApply(int model, const double *k, const magDataSet &raw, magDataSet &cor, int threads=0);     // cor: time copied from raw
+
+// samples with ||cor|-1| <= threshold, mask[i]=1 for them and 0 otherwise when mask is not null
+size_t magApplyInliers(int model, const double *k, const magDataSpan &raw, double threshold, uint8_t *mask=nullptr, int threads=0);
+
+const char *magApplyIsa(void);
+
+// throughput of the kernel against the per-sample reference (magModelApply and
+// a separate magnitude pass), 56 bytes per sample (3 loads, 4 stores), logged in GB/s
+void magApplyBenchmark(int model, const double *k, const magDataSpan &raw);
+
+#endif // MAGAPPLY_H
@@ -0,0 +1,440 @@
+/*
+MIT License
+
+Copyright (c) 2021 WagonWheelRobotics
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#include "magBatch.h"
+
+#include <QCommandLineParser>
+#include <QDir>
+#include <QFileInfo>
+#include <QSaveFile>
+#include <QElapsedTimer>
+#include <QDateTime>
+#include <QJsonArray>
+#include <QJsonObject>
+#include <QJsonDocument>
+#include <QTextStream>
+#include <QDebug>
+
+#include <Eigen/Geometry>
+
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <limits>
+#include <mutex>
+#include <vector>
+
+#include "configStorage.h"
+#include "magLoader.h"
+#include "magModel.h"
+#include "parallel.h"
+#include "solver.h"
+#include "solverCache.h"
+#include "solverResample.h"
+
+typedef struct
+{
+    QString fileName;
+    QString output;
+    int result;
+    QString error;
+    size_t samples;
+    double rms;
+    double loadMs;
+    double solveMs;
+    solverReport report;
+} batchItem_t;
+
+// the same for every file
+typedef struct
+{
+    double t0;
+    double t1;
+    int model;
+    int fastMode;
+    solverOptions options;
+    bool cache;
+    int resampleMode;
+    int resampleCount;      // 0: no resampling
+    int joint;              // 1: multi-sensor logs, solveJoint
+} batchJob_t;
+
+bool magBatchRequested(int argc, char *argv[])
+{
+    for(int i=1;i<argc;i++)
+    {
+        if(std::strcmp(argv[i],"--batch")==0) return true;
+    }
+    return false;
+}
+
+// wildcards are expanded in the file name part only, dir/*.csv
+static QStringList expand(const QStringList &patterns)
+{
+    QStringList files;
+    for(const auto &p:patterns)
+    {
+        QFileInfo fi(p);
+        if(fi.fileName().contains('*') || fi.fileName().contains('?'))
+        {
+            QDir d(fi.path());
+            for(const auto &e:d.entryInfoList(QStringList{fi.fileName()}, QDir::Files, QDir::Name))
+            {
+                files << e.absoluteFilePath();
+            }
+        }
+        else if(fi.isFile())
+        {
+            files << fi.absoluteFilePath();
+        }
+        else
+        {
+            qWarning()<<p<<"is not found";
+        }
+    }
+    files.removeDuplicates();
+    return files;
+}
+
+static int writeJson(batchItem_t &item, const QVariantMap &m)
+{
+    QSaveFile f(item.output);
+    if(!f.open(QIODevice::WriteOnly|QIODevice::Text))
+    {
+        item.error = "can not write " + item.output;
+        return 0;
+    }
+    f.write(QJsonDocument(QJsonObject::fromVariantMap(m)).toJson());
+    if(!f.commit())
+    {
+        item.error = "can not write " + item.output;
+        return 0;
+    }
+    return 1;
+}
+
+// one result per sensor, the rotation maps the corrected field of a sensor into the frame of the first one
+static int processJoint(batchItem_t &item, const batchJob_t &job)
+{
+    const solverOptions &options=job.options;
+
+    QElapsedTimer timer;
+    timer.start();
+
+    magLoader loader;
+    loader.setThreads(options.threads);
+    std::vector<magDataSet> data;
+    if(!loader.loadSensors(item.fileName, data))
+    {
+        item.error = "not loaded";
+        return 0;
+    }
+    item.loadMs = timer.nsecsElapsed()*1e-6;
+
+    timer.restart();
+    std::vector<magDataSpan> spans;
+    for(const auto &d:data) spans.push_back(d.span());
+
+    std::vector<QVector<double> > k, rotation;
+    if(!solveJoint(spans, job.t0, job.t1, k, rotation, job.model, options, solverCallback(), &item.report))
+    {
+        item.error = "not solved";
+        return 0;
+    }
+    item.solveMs = timer.nsecsElapsed()*1e-6;
+
+    // the sensors share the time column of the log, samples are per sensor
+    item.samples = spans.empty() ? 0 : spans[0].range(job.t0, job.t1).size();
+
+    QVariantList sensors;
+    item.rms = 0.0;
+    for(size_t s=0;s<data.size();s++)
+    {
+        const magDataSpan d=spans[s].range(job.t0, job.t1);
+
+        double rms=0.0;
+        magModelDispatch(job.model, [&](auto m)
+        {
+            rms = magModelRms<decltype(m)>(k[s].constData(), d.x, d.y, d.z, d.size());
+        });
+        item.rms += rms/data.size();
+
+        const Eigen::Vector3d r(rotation[s][0], rotation[s][1], rotation[s][2]);
+        const Eigen::Matrix3d R = r.norm()>0.0 ? Eigen::AngleAxisd(r.norm(), r.normalized()).toRotationMatrix() : Eigen::Matrix3d::Identity();
+        QVariantList rv, Rv;
+        for(int i=0;i<3;i++) rv.append(r[i]);
+        for(int i=0;i<3;i++) for(int j=0;j<3;j++) Rv.append(R(i,j));    // row major
+
+        QVariantMap m=magModelToVariant(job.model, k[s].constData());
+        m["rms"] = rms;
+        m["rotation"] = rv;
+        m["R"] = Rv;
+        sensors.append(m);
+    }
+
+    QVariantMap m;
+    m["date"] = QDateTime::currentDateTimeUtc().toString();
+    m["source"] = item.fileName;
+    m["samples"] = (qulonglong)item.samples;     // per sensor
+    m["rms"] = item.rms;
+    m["solver"] = item.report.toVariant();
+    m["sensors"] = sensors;
+    return writeJson(item, m);
+}
+
+static int process(batchItem_t &item, const batchJob_t &job)
+{
+    if(job.joint) return processJoint(item, job);
+
+    const double t0=job.t0;
+    const double t1=job.t1;
+    const int model=job.model;
+    const solverOptions &options=job.options;
+
+    QElapsedTimer timer;
+    timer.start();
+
+    magLoader loader;
+    loader.setThreads(options.threads);
+    loader.setCacheEnabled(job.cache);
+    magDataSet data;
+    if(!loader.load(item.fileName, data))
+    {
+        item.error = "not loaded";
+        return 0;
+    }
+    item.loadMs = timer.nsecsElapsed()*1e-6;
+
+    timer.restart();
+    const magDataSpan d=data.range(t0, t1);
+    item.samples = d.size();
+
+    QVector<double> k;
+    QVariantMap uncertainty;
+    int solved=0;
+    if(job.resampleCount>0)
+    {
+        solverResample r;
+        solved = solveResample(data.span(), t0, t1, model, job.resampleMode, job.resampleCount, options, r);
+        k = r.k;
+        uncertainty = r.toVariant();
+    }
+    else
+    {
+        solved = job.cache ? solveCached(data.span(), t0, t1, k, model, job.fastMode, options, solverCallback(), &item.report)
+                           : solve(data.span(), t0, t1, k, model, job.fastMode, options, solverCallback(), QVector<double>(), &item.report);
+        if(!item.report.covariance.isEmpty())
+        {
+            const QVariantMap m=item.report.toVariant();
+            uncertainty["covariance"] = m["covariance"];
+            uncertainty["sigma"] = m["sigma"];
+        }
+    }
+    if(!solved)
+    {
+        item.error = "not solved";
+        return 0;
+    }
+    item.solveMs = timer.nsecsElapsed()*1e-6;
+
+    magModelDispatch(model, [&](auto m)
+    {
+        item.rms = magModelRms<decltype(m)>(k.constData(), d.x, d.y, d.z, d.size());
+    });
+
+    QVariantMap m=magModelToVariant(model, k.constData());
+    m["date"] = QDateTime::currentDateTimeUtc().toString();
+    m["source"] = item.fileName;
+    m["samples"] = (qulonglong)item.samples;
+    m["rms"] = item.rms;
+    m["solver"] = item.report.toVariant();
+    if(!uncertainty.isEmpty()) m["uncertainty"] = uncertainty;
+    return writeJson(item, m);
+}
+
+int magBatch(const QStringList &arguments)
+{
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Headless batch calibration");
+    parser.addHelpOption();
+    parser.addPositionalArgument("files", "Log files, wildcards are allowed (dir/*.csv).", "<files...>");
+    parser.addOptions({
+        {"batch", "Batch mode."},
+        {{"o","output"}, "Output directory, default: next to the log file.", "dir"},
+        {{"m","model"}, QString("Calibration model: %1.").arg(magModelNames().join(", ")), "name", magModelNames().value(MAG_MODEL_QUADRATIC)},
+        {{"j","jobs"}, "Files solved in parallel, 0: all cores.", "n", "0"},
+        {"t0", "Start time of the calibration range.", "time"},
+        {"t1", "End time of the calibration range.", "time"},
+        {"fast", "Closed-form ellipsoid fit only."},
+        {"cell-samples", "Samples kept per sphere cell, 0: all.", "n"},
+        {"summary", "Write the summary as JSON.", "file"},
+        {"no-cache", "Do not use the .magbin sidecars and the result cache."},
+        {"covariance", "Parameter covariance of the solution."},
+        {"robust", "Reject outliers (RANSAC) before solving."},
+        {"robust-threshold", "Inlier threshold of --robust, relative to the field.", "x"},
+        {"bootstrap", "Confidence intervals from n bootstrap resamples.", "n"},
+        {"kfold", "Confidence intervals and out-of-sample residuals from k folds.", "k"},
+        {"joint", "Multi-sensor logs (t,x0,y0,z0,x1,y1,z1,...), all sensors and their rotations are solved together."},
+    });
+    parser.process(arguments);
+
+    const QStringList files=expand(parser.positionalArguments());
+    if(files.isEmpty())
+    {
+        qWarning()<<"No input files";
+        return 2;
+    }
+
+    const int model=magModelFind(parser.value("model"));
+    if(model<0)
+    {
+        qWarning()<<"Unknown model"<<parser.value("model");
+        return 2;
+    }
+
+    const double inf=std::numeric_limits<double>::infinity();
+    batchJob_t job;
+    job.t0 = parser.isSet("t0") ? parser.value("t0").toDouble() : -inf;
+    job.t1 = parser.isSet("t1") ? parser.value("t1").toDouble() : inf;
+    job.model = model;
+    job.fastMode = parser.isSet("fast") ? 1 : 0;
+    job.cache = !parser.isSet("no-cache");
+    job.resampleMode = parser.isSet("kfold") ? SOLVER_RESAMPLE_KFOLD : SOLVER_RESAMPLE_BOOTSTRAP;
+    job.resampleCount = parser.isSet("kfold") ? parser.value("kfold").toInt() : parser.value("bootstrap").toInt();
+    job.joint = parser.isSet("joint") ? 1 : 0;
+    if(job.joint)
+    {
+        // solveJoint keeps the rows of all sensors together, no resampling, decimation or robust stage
+        for(const char *o:{"bootstrap", "kfold", "covariance", "fast", "robust", "robust-threshold", "cell-samples"})
+        {
+            if(parser.isSet(o))
+            {
+                qWarning()<<"--joint does not support"<<QString("--%1").arg(o);
+                return 2;
+            }
+        }
+    }
+
+    // solver options of the GUI, cores are shared between the files
+    configStorage s("solver", nullptr);
+    solverOptions options=solverOptions::fromVariant(s.load("options"));
+    if(parser.isSet("cell-samples")) options.cellSamples = std::max(0, parser.value("cell-samples").toInt());
+    if(parser.isSet("covariance")) options.covariance = 1;
+    if(parser.isSet("robust")) options.robust = 1;
+    if(parser.isSet("robust-threshold")) options.robustThreshold = std::min(std::max(1e-4, parser.value("robust-threshold").toDouble()), 1.0);
+    const int cores=parallel::threads();
+    const int jobs=std::min(parallel::threads(parser.value("jobs").toInt()), files.size());
+    options.threads = std::max(1, cores/jobs);
+    options.verbose = 0;
+    job.options = options;
+
+    QDir outDir(parser.value("output"));
+    if(parser.isSet("output") && !outDir.exists()) outDir.mkpath(".");
+
+    std::vector<batchItem_t> items(files.size());
+    for(int i=0;i<files.size();i++)
+    {
+        batchItem_t &item=items[i];
+        item.fileName = files[i];
+        item.output = parser.isSet("output") ? outDir.filePath(QFileInfo(files[i]).fileName()+".calib.json") : files[i]+".calib.json";
+        item.result = 0;
+        item.samples = 0;
+        item.rms = 0.0;
+        item.loadMs = 0.0;
+        item.solveMs = 0.0;
+    }
+
+    QTextStream out(stdout);
+    out << "Calibrating " << files.size() << " files, " << jobs << " jobs x " << options.threads << " threads, "
+        << magModelNames().value(model) << " model" << "\n";
+
+    QElapsedTimer wall;
+    wall.start();
+    std::mutex outMutex;
+    std::atomic<int> finished(0);
+    parallel::forEach(items.size(), [&](size_t i, int)
+    {
+        batchItem_t &item=items[i];
+        item.result = process(item, job);
+
+        std::lock_guard<std::mutex> lock(outMutex);
+        out << "[" << ++finished << "/" << items.size() << "] " << QFileInfo(item.fileName).fileName() << ": "
+            << (item.result ? QString("rms %1").arg(item.rms,0,'g',6) : item.error)
+            << (item.report.cached==1 ? " (cached)" : "") << "\n";
+        out.flush();
+    }, jobs);
+    const double wallMs=wall.nsecsElapsed()*1e-6;
+    out.flush();
+
+    // summary
+    int ok=0;
+    QJsonArray summary;
+    out << "\n" << QString("%1 %2 %3 %4 %5").arg("samples",10).arg("rms",12).arg("load ms",10).arg("solve ms",10).arg("file") << "\n";
+    for(const auto &item:items)
+    {
+        if(item.result) ok++;
+        out << QString("%1 %2 %3 %4 %5").arg((qulonglong)item.samples,10)
+                                         .arg(item.result ? QString::number(item.rms,'g',6) : item.error,12)
+                                         .arg(item.loadMs,10,'f',1).arg(item.solveMs,10,'f',1)
+                                         .arg(item.fileName) << "\n";
+
+        QJsonObject o;
+        o["file"] = item.fileName;
+        o["output"] = item.output;
+        o["result"] = item.result;
+        if(!item.result) o["error"] = item.error;
+        o["samples"] = (double)item.samples;
+        o["rms"] = item.rms;
+        o["loadMs"] = item.loadMs;
+        o["solveMs"] = item.solveMs;
+        o["cached"] = item.report.cached;
+        summary.append(o);
+    }
+    out << ok << " of " << items.size() << " files are calibrated in " << wallMs*1e-3 << " s" << "\n";
+    out.flush();
+
+    if(parser.isSet("summary"))
+    {
+        QJsonObject root;
+        root["date"] = QDateTime::currentDateTimeUtc().toString();
+        root["model"] = magModelNames().value(model);
+        root["jobs"] = jobs;
+        root["threads"] = options.threads;
+        root["wallMs"] = wallMs;
+        root["files"] = summary;
+
+        QSaveFile f(parser.value("summary"));
+        if(f.open(QIODevice::WriteOnly|QIODevice::Text))
+        {
+            f.write(QJsonDocument(root).toJson());
+            if(!f.commit()) qWarning()<<"Can not write"<<parser.value("summary");
+        }
+        else
+        {
+            qWarning()<<"Can not write"<<parser.value("summary");
+        }
+    }
+
+    return ok==(int)items.size() ? 0 : 1;
+}
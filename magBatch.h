@@ -0,0 +1,42 @@
+#ifndef MAGBATCH_H
+#define MAGBATCH_H
+
+/*
+MIT License
+
+Copyright (c) 2021 WagonWheelRobotics
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#include <QStringList>
+
+// Headless batch calibration
+//
+//   magCal --batch [options] <log files or wildcards...>
+//
+// Every file is loaded, solved and exported as <log>.calib.json (or into --output),
+// files are processed in parallel, one per worker. A summary with the residual RMS
+// and the timings of every file is printed and optionally written as JSON.
+// Only QCoreApplication is needed, no display.
+
+bool magBatchRequested(int argc, char *argv[]);
+int magBatch(const QStringList &arguments);
+
+#endif // MAGBATCH_H
@@ -23,6 +23,9 @@ DEFINES += USE_PLOT_VIEW
 #DEFINES += EXAMPLE_CODE_QCP # effective when USE_PLOT_VIEW is defined
 #DEFINES += EXAMPLE_CODE_QCP_STATIC_PLOT    # comment out for realtime
 
+#DEFINES += APPLY_BENCHMARK    # log the throughput of the calibration apply kernel in plotCor
+#QMAKE_CXXFLAGS += -mavx2 -mfma    # AVX apply kernel (MSVC: /arch:AVX2), SSE2 otherwise
+
 # EDL (Part of Cloud compare) is GPL, effective when USE_3D_VIEW is defined
 DEFINES += USE_EDL
 
@@ -34,6 +37,8 @@ DEFINES += USE_QGEOVIEW
 
 include(thirdParty/ceres/ceres.pri)
 include(utils/utils.pri)
+include(magData/magData.pri)
+include(magStream/magStream.pri)
 contains(DEFINES,USE_3D_VIEW):include(glView/glView.pri)
 contains(DEFINES,USE_IMAGE_VIEW):include(imageView/imageView.pri)
 contains(DEFINES,USE_PLOT_VIEW):include(plotView/plotView.pri)
@@ -43,11 +48,34 @@ SOURCES += \
     calibOptionsDialog.cpp \
     main.cpp \
     MainWindow.cpp \
+    ellipsoidFit.cpp \
+    magApply.cpp \
+    magBatch.cpp \
+    magOnlineCalib.cpp \
+    magReplay.cpp \
+    magSolver.cpp \
+    robustFit.cpp \
+    sphereCoverage.cpp \
+    solverCache.cpp \
+    solverResample.cpp \
     solver.cpp
 
 HEADERS += \
     MainWindow.h \
-    calibOptionsDialog.h
+    calibOptionsDialog.h \
+    ellipsoidFit.h \
+    magApply.h \
+    magBatch.h \
+    magModel.h \
+    magOnlineCalib.h \
+    magReplay.h \
+    magSolver.h \
+    robustFit.h \
+    sphereCoverage.h \
+    solverCache.h \
+    solverCost.h \
+    solverResample.h \
+    solver.h
 
 FORMS += \
     MainWindow.ui \
@@ -0,0 +1,311 @@
+/*
+MIT License
+
+Copyright (c) 2021 WagonWheelRobotics
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#include "magBin.h"
+
+#include <QFile>
+#include <QSaveFile>
+#include <QDebug>
+#include <QtEndian>
+#include <QSysInfo>
+
+#include "parallel.h"
+
+#include <cstring>
+#include <vector>
+
+#define MAGBIN_HASH_BLOCK   (16<<20)
+
+static const char magbin_magic[8]={'M','A','G','B','I','N','1','\0'};
+
+static const uint64_t PRIME1=0x9E3779B185EBCA87ULL;
+static const uint64_t PRIME2=0xC2B2AE3D27D4EB4FULL;
+static const uint64_t PRIME3=0x165667B19E3779F9ULL;
+
+static inline uint64_t rotl(uint64_t x, int r)
+{
+    return (x<<r) | (x>>(64-r));
+}
+
+static inline uint64_t avalanche(uint64_t h)
+{
+    h ^= h>>33;
+    h *= PRIME2;
+    h ^= h>>29;
+    h *= PRIME3;
+    h ^= h>>32;
+    return h;
+}
+
+// single lane xxhash style block hash
+static uint64_t hashBlock(const uint8_t *p, size_t n, uint64_t seed)
+{
+    uint64_t h=seed + PRIME3 + (uint64_t)n*PRIME1;
+    while(n>=8)
+    {
+        uint64_t v;
+        std::memcpy(&v,p,8);
+        h ^= rotl(qFromLittleEndian(v)*PRIME2,31)*PRIME1;
+        h = rotl(h,27)*PRIME1 + PRIME3;
+        p+=8;
+        n-=8;
+    }
+    while(n--)
+    {
+        h ^= (*p++)*PRIME3;
+        h = rotl(h,11)*PRIME1;
+    }
+    return avalanche(h);
+}
+
+// blocks are hashed in parallel, then the list of block hashes is hashed
+uint64_t magbin_hash(const uint8_t *buf, size_t length, int threads)
+{
+    size_t nBlock=(length+MAGBIN_HASH_BLOCK-1)/MAGBIN_HASH_BLOCK;
+    std::vector<uint64_t> h(nBlock);
+    parallel::forEach(nBlock, [&](size_t i, int)
+    {
+        size_t pos=i*MAGBIN_HASH_BLOCK;
+        size_t len=std::min<size_t>(MAGBIN_HASH_BLOCK, length-pos);
+        h[i]=qToLittleEndian(hashBlock(buf+pos, len, i));
+    }, threads);
+    return hashBlock((const uint8_t*)h.data(), h.size()*sizeof(uint64_t), length);
+}
+
+QString magbin_sidecar(const QString &fileName, int sensor)
+{
+    if(sensor>0) return fileName + QString(".s%1.magbin").arg(sensor);
+    return fileName + ".magbin";
+}
+
+QString magbin_source_log(const QString &fileName)
+{
+    if(!fileName.endsWith(".magbin", Qt::CaseInsensitive)) return QString();
+    QString log=fileName.left(fileName.size()-7);
+
+    // .sk of sensor k>0
+    const int dot=log.lastIndexOf(".s");
+    if(dot>0 && dot+2<log.size())
+    {
+        bool digits=true;
+        for(int i=dot+2;i<log.size();i++) digits = digits && log[i].isDigit();
+        if(digits && !QFile::exists(log)) log.truncate(dot);
+    }
+    return log;
+}
+
+static inline size_t align64(size_t x)
+{
+    return (x+63) & ~(size_t)63;
+}
+
+template <typename T> static inline T get(const uint8_t *p)
+{
+    return qFromLittleEndian<T>(p);
+}
+
+static inline double getDouble(const uint8_t *p)
+{
+    uint64_t v=get<uint64_t>(p);
+    double d;
+    std::memcpy(&d,&v,sizeof(d));
+    return d;
+}
+
+static inline void putDouble(double d, uint8_t *p)
+{
+    uint64_t v;
+    std::memcpy(&v,&d,sizeof(v));
+    qToLittleEndian<uint64_t>(v,p);
+}
+
+// columns are raw little endian values, big endian hosts do not use the cache
+// source: nullptr accepts any source size and hash
+static int import_magbin(const QString &fileName, magDataSet &data, const magbin_source_t *source, int *columns)
+{
+    if(QSysInfo::ByteOrder!=QSysInfo::LittleEndian) return 0;
+
+    QFile f(fileName);
+    if(!f.exists()) return 0;
+    if(!f.open(QIODevice::ReadOnly)) return 0;
+
+    int ret=0;
+    const qint64 size=f.size();
+    const uint8_t *m = size>=MAGBIN_HEADER_SIZE ? f.map(0,size) : nullptr;
+    if(m!=nullptr)
+    {
+        const uint32_t version=get<uint32_t>(m+8);
+        const uint32_t header=get<uint32_t>(m+12);
+        const uint32_t cols=get<uint32_t>(m+16);
+        const uint32_t type=get<uint32_t>(m+20);
+        const uint64_t rows=get<uint64_t>(m+24);
+        const size_t elem = type==MAGBIN_TYPE_FLOAT ? sizeof(float) : sizeof(double);
+
+        bool ok = std::memcmp(m,magbin_magic,8)==0
+               && version==MAGBIN_VERSION && header==MAGBIN_HEADER_SIZE
+               && (type==MAGBIN_TYPE_DOUBLE || type==MAGBIN_TYPE_FLOAT)
+               && (source==nullptr || (get<uint64_t>(m+40)==source->size && get<uint64_t>(m+48)==source->hash));
+
+        uint64_t offset[5];
+        for(int i=0;i<5 && ok;i++)
+        {
+            offset[i]=get<uint64_t>(m+56+8*i);
+            // rows of a broken header may overflow rows*elem, divide instead
+            ok = (offset[i]%64)==0 && offset[i]>=MAGBIN_HEADER_SIZE && offset[i]<=(uint64_t)size
+              && rows<=((uint64_t)size-offset[i])/elem;
+        }
+
+        if(ok)
+        {
+            data.clear();
+            data.resize(rows);
+            data.setTimeBase(getDouble(m+32));
+            double *dst[5]={data.t(), data.x(), data.y(), data.z(), data.w()};
+            parallel::forEach(5, [&](size_t i, int)
+            {
+                if(type==MAGBIN_TYPE_DOUBLE)
+                {
+                    std::memcpy(dst[i], m+offset[i], rows*sizeof(double));
+                }
+                else
+                {
+                    const float *src=(const float*)(m+offset[i]);
+                    for(uint64_t r=0;r<rows;r++) dst[i][r]=src[r];
+                }
+            });
+            if(columns!=nullptr) *columns=(int)cols;
+            ret=1;
+        }
+        f.unmap((uchar*)m);
+    }
+    f.close();
+    return ret;
+}
+
+int import_magbin(const QString &fileName, magDataSet &data, const magbin_source_t &source, int *columns)
+{
+    return import_magbin(fileName, data, &source, columns);
+}
+
+int import_magbin(const QString &fileName, magDataSet &data, int *columns)
+{
+    return import_magbin(fileName, data, nullptr, columns);
+}
+
+int magbin_stale(const QString &fileName, int threads)
+{
+    QFile f(fileName);
+    if(!f.open(QIODevice::ReadOnly) || f.size()<MAGBIN_HEADER_SIZE) return 0;
+    const uint8_t *m=f.map(0,MAGBIN_HEADER_SIZE);
+    if(m==nullptr) return 0;
+    const bool ok=std::memcmp(m,magbin_magic,8)==0 && get<uint32_t>(m+8)==MAGBIN_VERSION;
+    const uint64_t size=get<uint64_t>(m+40);
+    const uint64_t hash=get<uint64_t>(m+48);
+    f.unmap((uchar*)m);
+    f.close();
+    if(!ok || (size==0 && hash==0)) return 0;       // not a magbin of this version, or a recording
+
+    QFile log(magbin_source_log(fileName));
+    if(log.fileName().isEmpty() || !log.open(QIODevice::ReadOnly)) return 0;
+    int ret=1;
+    if((uint64_t)log.size()==size)
+    {
+        const uint8_t *p = size>0 ? log.map(0, (qint64)size) : nullptr;
+        if(p!=nullptr)
+        {
+            ret = magbin_hash(p, (size_t)size, threads)!=hash ? 1 : 0;
+            log.unmap((uchar*)p);
+        }
+    }
+    log.close();
+    return ret;
+}
+
+template <typename T> static bool writeColumn(QSaveFile &f, const double *v, size_t n)
+{
+    std::vector<T> buf;
+    const size_t block=1<<16;
+    buf.resize(std::min(n,block));
+    for(size_t pos=0;pos<n;pos+=block)
+    {
+        size_t len=std::min(block,n-pos);
+        for(size_t i=0;i<len;i++) buf[i]=(T)v[pos+i];
+        if(f.write((const char*)buf.data(), len*sizeof(T))!=(qint64)(len*sizeof(T))) return false;
+    }
+    return true;
+}
+
+void magbin_header(uint8_t *header, size_t rows, double timeBase, int columns, int type, const magbin_source_t &source, const uint64_t *offset)
+{
+    std::memset(header,0,MAGBIN_HEADER_SIZE);
+    std::memcpy(header,magbin_magic,8);
+    qToLittleEndian<uint32_t>(MAGBIN_VERSION, header+8);
+    qToLittleEndian<uint32_t>(MAGBIN_HEADER_SIZE, header+12);
+    qToLittleEndian<uint32_t>((uint32_t)columns, header+16);
+    qToLittleEndian<uint32_t>((uint32_t)type, header+20);
+    qToLittleEndian<uint64_t>(rows, header+24);
+    putDouble(timeBase, header+32);
+    qToLittleEndian<uint64_t>(source.size, header+40);
+    qToLittleEndian<uint64_t>(source.hash, header+48);
+    for(int i=0;i<5;i++) qToLittleEndian<uint64_t>(offset[i], header+56+8*i);
+}
+
+int export_magbin(const QString &fileName, const magDataSet &data, int columns, const magbin_source_t &source, int type)
+{
+    if(QSysInfo::ByteOrder!=QSysInfo::LittleEndian) return 0;
+
+    QSaveFile f(fileName);
+    if(!f.open(QIODevice::WriteOnly)) return 0;
+
+    const size_t rows=data.size();
+    const size_t elem = type==MAGBIN_TYPE_FLOAT ? sizeof(float) : sizeof(double);
+
+    uint64_t offset[5];
+    size_t pos=MAGBIN_HEADER_SIZE;
+    for(int i=0;i<5;i++)
+    {
+        offset[i]=pos;
+        pos=align64(pos+rows*elem);
+    }
+
+    uint8_t header[MAGBIN_HEADER_SIZE];
+    magbin_header(header, rows, data.timeBase(), columns, type, source, offset);
+
+    bool ok = f.write((const char*)header, sizeof(header))==(qint64)sizeof(header);
+
+    const double *src[5]={data.t(), data.x(), data.y(), data.z(), data.w()};
+    const char pad[64]={0};
+    for(int i=0;i<5 && ok;i++)
+    {
+        if(f.pos()<(qint64)offset[i]) ok = f.write(pad, offset[i]-f.pos())>0;
+        if(ok) ok = type==MAGBIN_TYPE_FLOAT ? writeColumn<float>(f,src[i],rows) : writeColumn<double>(f,src[i],rows);
+    }
+
+    if(!ok)
+    {
+        f.cancelWriting();
+        return 0;
+    }
+    return f.commit() ? 1 : 0;
+}
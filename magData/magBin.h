@@ -0,0 +1,81 @@
+#ifndef MAGBIN_H
+#define MAGBIN_H
+
+/*
+MIT License
+
+Copyright (c) 2021 WagonWheelRobotics
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#include <QString>
+
+#include <cstdint>
+
+#include "magDataSet.h"
+
+// .magbin dataset cache
+// A sidecar of the text log (log.csv -> log.csv.magbin) which holds the parsed columns.
+// Sensor k>0 of a multi-sensor log has a sidecar of its own (log.csv.s1.magbin, ...).
+// A dataset recorded from a stream (magRecorder) is a .magbin without a source log,
+// source size and hash are 0.
+// All fields are little endian, every column starts at a 64 byte boundary
+// so the file can be mapped and the columns used as they are.
+//
+//  offset  size
+//  0       8       magic "MAGBIN1\0"
+//  8       4       version
+//  12      4       header size (128)
+//  16      4       column count of the source log (3: no time stamp)
+//  20      4       value type (0:double, 1:float)
+//  24      8       rows
+//  32      8       time base (time of the first row)
+//  40      8       source file size
+//  48      8       source file content hash (magbin_hash)
+//  56      40      offset of t,x,y,z,w columns
+//  96      32      reserved
+
+#define MAGBIN_VERSION      1
+#define MAGBIN_HEADER_SIZE  128
+#define MAGBIN_TYPE_DOUBLE  0
+#define MAGBIN_TYPE_FLOAT   1
+
+typedef struct
+{
+    uint64_t size;
+    uint64_t hash;
+} magbin_source_t;
+
+uint64_t magbin_hash(const uint8_t *buf, size_t length, int threads=0);
+QString magbin_sidecar(const QString &fileName, int sensor=0);     // sensor k>0 of multi-sensor rows: log.csv.sk.magbin
+QString magbin_source_log(const QString &fileName);                // log.csv of log.csv.magbin and log.csv.sk.magbin
+
+// 1: the source log next to a sidecar exists and no longer has the size and hash of the header
+// (hashed only when the size matches), 0: it matches, there is none, or the file has no source
+int magbin_stale(const QString &fileName, int threads=0);
+
+// fills the MAGBIN_HEADER_SIZE bytes of a header, offset: file offsets of the t,x,y,z,w columns
+void magbin_header(uint8_t *header, size_t rows, double timeBase, int columns, int type, const magbin_source_t &source, const uint64_t *offset);
+
+int import_magbin(const QString &fileName, magDataSet &data, const magbin_source_t &source, int *columns=nullptr);
+int import_magbin(const QString &fileName, magDataSet &data, int *columns=nullptr);    // any source, a recording or a sidecar opened by itself
+int export_magbin(const QString &fileName, const magDataSet &data, int columns, const magbin_source_t &source, int type=MAGBIN_TYPE_DOUBLE);
+
+#endif // MAGBIN_H
@@ -0,0 +1,14 @@
+
+HEADERS += \
+    $$PWD/magBin.h \
+    $$PWD/magDataSet.h \
+    $$PWD/magLoader.h \
+    $$PWD/magLogParser.h
+
+SOURCES += \
+    $$PWD/magBin.cpp \
+    $$PWD/magDataSet.cpp \
+    $$PWD/magLoader.cpp \
+    $$PWD/magLogParser.cpp
+
+INCLUDEPATH += $$PWD
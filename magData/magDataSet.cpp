@@ -0,0 +1,108 @@
+/*
+MIT License
+
+Copyright (c) 2021 WagonWheelRobotics
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#include "magDataSet.h"
+
+#include <algorithm>
+#include <cmath>
+#include <numeric>
+
+magDataSet::magDataSet()
+{
+    _timeBase = 0.0;
+}
+
+void magDataSet::clear()
+{
+    _t.clear();
+    _x.clear();
+    _y.clear();
+    _z.clear();
+    _w.clear();
+    _timeBase = 0.0;
+}
+
+void magDataSet::reserve(size_t n)
+{
+    _t.reserve(n);
+    _x.reserve(n);
+    _y.reserve(n);
+    _z.reserve(n);
+    _w.reserve(n);
+}
+
+void magDataSet::resize(size_t n)
+{
+    _t.resize(n);
+    _x.resize(n);
+    _y.resize(n);
+    _z.resize(n);
+    _w.resize(n);
+}
+
+void magDataSet::append(double t, double x, double y, double z)
+{
+    _t.push_back(t);
+    _x.push_back(x);
+    _y.push_back(y);
+    _z.push_back(z);
+    _w.push_back(std::sqrt(x*x + y*y + z*z));
+}
+
+void magDataSet::updateMagnitude(void)
+{
+    const size_t n=size();
+    const double *x=_x.data(), *y=_y.data(), *z=_z.data();
+    double *w=_w.data();
+    for(size_t i=0;i<n;i++)
+    {
+        w[i] = std::sqrt(x[i]*x[i] + y[i]*y[i] + z[i]*z[i]);
+    }
+}
+
+bool magDataSet::isSorted() const
+{
+    const double *t=_t.data();
+    for(size_t i=1;i<size();i++)
+    {
+        if(!(t[i-1]<=t[i])) return false;
+    }
+    return true;
+}
+
+void magDataSet::sortByTime(void)
+{
+    const size_t n=size();
+    std::vector<size_t> order(n);
+    std::iota(order.begin(), order.end(), 0);
+    const double *t=_t.data();
+    std::stable_sort(order.begin(), order.end(), [=](size_t a, size_t b){return t[a]<t[b];});
+
+    magColumn tmp(n);
+    for(magColumn *c:{&_t, &_x, &_y, &_z, &_w})
+    {
+        for(size_t i=0;i<n;i++) tmp[i] = (*c)[order[i]];
+        c->swap(tmp);
+    }
+}
@@ -0,0 +1,131 @@
+#ifndef MAGDATASET_H
+#define MAGDATASET_H
+
+/*
+MIT License
+
+Copyright (c) 2021 WagonWheelRobotics
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#include <algorithm>
+#include <cstddef>
+#include <new>
+#include <vector>
+
+#define MAG_DATA_ALIGN  64      // cache line, enough for AVX-512
+
+template <typename T, size_t A> struct alignedAllocator
+{
+    typedef T value_type;
+    template <typename U> struct rebind {typedef alignedAllocator<U,A> other;};
+
+    alignedAllocator() noexcept {}
+    template <typename U> alignedAllocator(const alignedAllocator<U,A> &) noexcept {}
+
+    T *allocate(size_t n) {return static_cast<T*>(::operator new(n*sizeof(T), std::align_val_t(A)));}
+    void deallocate(T *p, size_t) noexcept {::operator delete(p, std::align_val_t(A));}
+
+    template <typename U> bool operator==(const alignedAllocator<U,A> &) const noexcept {return true;}
+    template <typename U> bool operator!=(const alignedAllocator<U,A> &) const noexcept {return false;}
+};
+
+typedef std::vector<double, alignedAllocator<double, MAG_DATA_ALIGN> > magColumn;
+
+// non-owning view of a dataset (or a part of it)
+struct magDataSpan
+{
+    const double *t;
+    const double *x;
+    const double *y;
+    const double *z;
+    const double *w;
+    size_t n;
+
+    size_t size() const {return n;}
+    bool empty() const {return n==0;}
+    magDataSpan mid(size_t pos, size_t len) const
+    {
+        if(pos>n) pos=n;
+        if(len>n-pos) len=n-pos;
+        return magDataSpan{t+pos, x+pos, y+pos, z+pos, w+pos, len};
+    }
+
+    // samples of t0<t<t1 by binary search, the time column must be ascending
+    magDataSpan range(double t0, double t1) const
+    {
+        const double *b=std::upper_bound(t, t+n, t0);
+        const double *e=std::lower_bound(b, t+n, t1);
+        return mid(b-t, e-b);
+    }
+};
+
+// columnar magnetometer samples (time,x,y,z,w)
+// w is the magnitude of (x,y,z), time is relative to timeBase()
+
+class magDataSet
+{
+public:
+    magDataSet();
+
+    void clear();
+    void reserve(size_t n);
+    void resize(size_t n);
+
+    size_t size() const {return _t.size();}
+    bool empty() const {return _t.empty();}
+
+    void append(double t, double x, double y, double z);
+    void updateMagnitude(void);
+
+    double *t() {return _t.data();}
+    double *x() {return _x.data();}
+    double *y() {return _y.data();}
+    double *z() {return _z.data();}
+    double *w() {return _w.data();}
+    const double *t() const {return _t.data();}
+    const double *x() const {return _x.data();}
+    const double *y() const {return _y.data();}
+    const double *z() const {return _z.data();}
+    const double *w() const {return _w.data();}
+
+    double front() const {return _t.front();}    // first time
+    double back() const {return _t.back();}      // last time
+
+    magDataSpan span() const {return magDataSpan{t(), x(), y(), z(), w(), size()};}
+    magDataSpan span(size_t pos, size_t len) const {return span().mid(pos,len);}
+    magDataSpan range(double t0, double t1) const {return span().range(t0,t1);}
+
+    bool isSorted() const;      // time is ascending (equal times allowed)
+    void sortByTime(void);      // stable
+
+    double timeBase() const {return _timeBase;}
+    void setTimeBase(double t) {_timeBase=t;}
+
+private:
+    magColumn _t;
+    magColumn _x;
+    magColumn _y;
+    magColumn _z;
+    magColumn _w;
+    double _timeBase;
+};
+
+#endif // MAGDATASET_H
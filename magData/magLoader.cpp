@@ -0,0 +1,217 @@
+/*
+MIT License
+
+Copyright (c) 2021 WagonWheelRobotics
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#include "magLoader.h"
+#include "magLogParser.h"
+#include "magBin.h"
+
+#include <QFile>
+#include <QElapsedTimer>
+#include <QThread>
+#include <QDebug>
+
+#include <algorithm>
+
+magLoader::magLoader(const QString &fileName, QObject *parent) : QObject(parent)
+{
+    _fileName = fileName;
+    _cacheEnabled = true;
+    _threads = 0;
+    _cancel = false;
+    _result = 0;
+}
+
+magLoader::~magLoader()
+{
+
+}
+
+int magLoader::prepare(magDataSet &data)
+{
+    return data.size()>0;
+}
+
+void magLoader::run(void)
+{
+    thread()->setPriority(QThread::LowPriority);
+    _result = load(_fileName, _data);
+    if(_result && !_cancel)
+    {
+        emit progress(0, 0, "Preparing");
+        if(!prepare(_data)) _result = 0;
+    }
+    if(_cancel)
+    {
+        qInfo()<<"Loading"<<_fileName<<"is canceled.";
+        _data.clear();
+        _result = 0;
+    }
+    emit done(this);
+}
+
+size_t magLoader::load(const QString &fileName, magDataSet &data)
+{
+    // a dataset recorded from a stream has no source log, a sidecar opened by itself
+    // is loaded as it is, with a warning if its log next to it has changed
+    if(fileName.endsWith(".magbin", Qt::CaseInsensitive))
+    {
+        if(magbin_stale(fileName, _threads))
+        {
+            qWarning()<<magbin_source_log(fileName)<<"has changed since"<<fileName<<"was written, open the log to parse it again";
+        }
+        if(!import_magbin(fileName, data))
+        {
+            qWarning()<<"Can not read"<<fileName<<"(not a magbin file of this version)";
+            return 0;
+        }
+        if(!data.isSorted())
+        {
+            qWarning()<<"Time stamps of"<<fileName<<"are not monotonic, rows are sorted by time";
+            data.sortByTime();
+        }
+        return data.size();
+    }
+
+    std::vector<magDataSet> sets;
+    const size_t r=loadLog(fileName, sets, false);
+    data = r>0 ? std::move(sets[0]) : magDataSet();
+    return r;
+}
+
+size_t magLoader::loadSensors(const QString &fileName, std::vector<magDataSet> &sensors)
+{
+    return loadLog(fileName, sensors, true);
+}
+
+// the sidecars of sensor 0 (all: of every sensor), 0 if one is missing or does not match the log
+static size_t importCache(const QString &fileName, const magbin_source_t &source, std::vector<magDataSet> &sets, bool all)
+{
+    int columns=0;
+    sets.resize(1);
+    if(!import_magbin(magbin_sidecar(fileName), sets[0], source, &columns))
+    {
+        sets.clear();
+        return 0;
+    }
+    const int n = all ? magLogParser::sensorsOf(columns) : 1;
+    sets.resize(std::max(n, 1));
+    for(int s=1;s<n;s++)
+    {
+        if(!import_magbin(magbin_sidecar(fileName, s), sets[s], source) || sets[s].size()!=sets[0].size())
+        {
+            sets.clear();
+            return 0;
+        }
+    }
+    for(auto &d:sets)
+    {
+        if(!d.isSorted()) d.sortByTime();     // written by an older version
+    }
+    return sets[0].size();
+}
+
+// allSensors: a dataset per sensor of multi-sensor rows, otherwise sensor 0 only
+size_t magLoader::loadLog(const QString &fileName, std::vector<magDataSet> &sets, bool allSensors)
+{
+    sets.clear();
+
+    QFile f(fileName);
+    if(!f.open(QIODevice::ReadOnly))
+    {
+        qWarning()<<"Can not open"<<fileName;
+        return 0;
+    }
+
+    QElapsedTimer timer;
+    timer.start();
+
+    const qint64 size=f.size();
+    const char *m = size>0 ? (const char*)f.map(0,size) : nullptr;
+    if(m==nullptr)
+    {
+        qWarning()<<"Can not map"<<fileName;
+        f.close();
+        return 0;
+    }
+
+    size_t r=0;
+    magbin_source_t source;
+    source.size = size;
+    source.hash = 0;
+    if(_cacheEnabled)
+    {
+        emit progress(0, size, "Hashing");
+        source.hash = magbin_hash((const uint8_t*)m, (size_t)size, _threads);
+        qInfo()<<"Hashed"<<fileName<<"in"<<timer.nsecsElapsed()*1e-6<<"ms";
+        timer.restart();    // the parse rate below is the parser alone
+        if(!_cancel) r = importCache(fileName, source, sets, allSensors);
+        if(r>0) qInfo()<<"Loaded"<<r<<"rows x"<<sets.size()<<"sensors from"<<magbin_sidecar(fileName)<<"in"<<timer.nsecsElapsed()*1e-6<<"ms";
+    }
+
+    if(r==0 && !_cancel)
+    {
+        magLogParser log(_threads);
+        log.setProgress([&](quint64 current, quint64 total)
+        {
+            emit progress(current, total, "Parsing");
+            return !_cancel;
+        });
+        log.parse(m, (size_t)size);
+        if(!_cancel)
+        {
+            const int n = allSensors ? log.sensors() : std::min(log.sensors(), 1);
+            for(int s=0;s<n;s++) sets.push_back(log.takeDataSet(s));
+            r = log.rows();
+
+            double sec=timer.nsecsElapsed()*1e-9;
+            qInfo()<<"Parsed"<<r<<"rows x"<<log.columns()<<"columns in"<<sec*1e3<<"ms,"
+                   <<(sec>0.0 ? size/sec/1e6 : 0.0)<<"MB/s";
+            if(log.rejected()) qWarning()<<log.rejected()<<"rows are skipped (column count mismatch or time is not finite)";
+
+            // window selection is a binary search on time, the cache stores the sorted rows,
+            // stable sort: the same permutation for every sensor
+            for(auto &d:sets)
+            {
+                if(d.isSorted()) continue;
+                if(&d==&sets[0]) qWarning()<<"Time stamps of"<<fileName<<"are not monotonic, rows are sorted by time";
+                d.sortByTime();
+            }
+
+            if(_cacheEnabled && r>0)
+            {
+                emit progress(0, 0, "Caching");
+                for(int s=0;s<n;s++)
+                {
+                    const QString sidecar=magbin_sidecar(fileName, s);
+                    if(!export_magbin(sidecar, sets[s], log.columns(), source)) qWarning()<<"Can not write"<<sidecar;
+                }
+            }
+        }
+    }
+
+    f.unmap((uchar*)m);
+    f.close();
+    if(_cancel) sets.clear();
+    return _cancel ? 0 : r;
+}
@@ -0,0 +1,90 @@
+#ifndef MAGLOADER_H
+#define MAGLOADER_H
+
+/*
+MIT License
+
+Copyright (c) 2021 WagonWheelRobotics
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#include <QObject>
+#include <QString>
+
+#include <atomic>
+#include <vector>
+
+#include "magDataSet.h"
+
+// Loads a magnetometer log into a dataset.
+// The parsed columns are cached in a .magbin sidecar, the sidecar is used
+// instead of parsing the text again when the size and content hash of the log match.
+// The loaded dataset is always sorted by time.
+// loadSensors() splits multi-sensor rows (t,x0,y0,z0,x1,y1,z1,...), every sensor
+// is cached in a sidecar of its own (magbin_sidecar()).
+// The log is hashed before the cache is read, the hash and the parse times are logged apart.
+//
+// load() runs in the caller's thread. For background loading, move the loader
+// to a worker thread and invoke run(), done() is emitted when finished
+// and takeDataSet() moves the result out. cancel() may be called from any thread.
+
+class magLoader : public QObject
+{
+    Q_OBJECT
+public:
+    explicit magLoader(const QString &fileName=QString(), QObject *parent=nullptr);
+    virtual ~magLoader();
+
+    size_t load(const QString &fileName, magDataSet &data);    // returns number of rows
+    size_t loadSensors(const QString &fileName, std::vector<magDataSet> &sensors);    // multi-sensor log, one dataset per sensor
+
+    void setCacheEnabled(bool enabled) {_cacheEnabled=enabled;}
+    void setThreads(int threads) {_threads=threads;}       // parsing and hashing, 0: all cores
+
+    void cancel(void) {_cancel=true;}
+    bool isCanceled(void) const {return _cancel;}
+
+    const QString &fileName() const {return _fileName;}
+    size_t result() const {return _result;}
+    magDataSet takeDataSet() {return std::move(_data);}
+
+public slots:
+    void run(void);     // worker thread
+
+signals:
+    void progress(quint64 current, quint64 total, QString label);
+    void done(QObject *x);
+
+protected:
+    virtual int prepare(magDataSet &data);   // called in the worker thread after loading
+
+private:
+    size_t loadLog(const QString &fileName, std::vector<magDataSet> &sets, bool allSensors);
+
+private:
+    QString _fileName;
+    bool _cacheEnabled;
+    int _threads;
+    std::atomic<bool> _cancel;
+    size_t _result;
+    magDataSet _data;
+};
+
+#endif // MAGLOADER_H
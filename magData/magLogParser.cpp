@@ -0,0 +1,267 @@
+/*
+MIT License
+
+Copyright (c) 2021 WagonWheelRobotics
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#include "magLogParser.h"
+
+#include "parallel.h"
+
+#include <algorithm>
+#include <atomic>
+#include <charconv>
+#include <cmath>
+#include <cstring>
+
+#define DETECT_LINES    32
+#define MAX_COLUMNS     64
+#define MIN_CHUNK_SIZE  (1<<20)
+
+static inline const char *skipBlank(const char *p, const char *end)
+{
+    while(p<end && (*p==' ' || *p=='\t' || *p=='\r')) p++;
+    return p;
+}
+
+static inline const char *nextLine(const char *p, const char *end)
+{
+    auto eol=(const char*)std::memchr(p, '\n', end-p);
+    return eol!=nullptr ? eol : end;
+}
+
+magLogParser::magLogParser(int threads)
+{
+    _threads = parallel::threads(threads);
+    _delimiter = 0;
+    _columns = 0;
+    _rejected = 0;
+    _rows = 0;
+}
+
+// returns number of values in the line, -1 if the line is not numeric
+int magLogParser::parseLine(const char *p, const char *eol, char delimiter, double *out, int maxColumns)
+{
+    int n=0;
+    p=skipBlank(p,eol);
+    if(p>=eol) return -1;   // empty line
+    for(;;)
+    {
+        if(*p=='+') p++;    // from_chars does not accept leading '+'
+        double v;
+        auto r=std::from_chars(p, eol, v);
+        if(r.ec!=std::errc()) return -1;
+        if(n<maxColumns) out[n]=v;
+        n++;
+
+        p=skipBlank(r.ptr,eol);
+        if(p>=eol) break;
+        if(delimiter!=' ')
+        {
+            if(*p!=delimiter) return -1;
+            p=skipBlank(p+1,eol);
+            if(p>=eol) return -1;   // trailing delimiter
+        }
+        else if(p==r.ptr)
+        {
+            return -1;  // no blank between numbers
+        }
+    }
+    return n;
+}
+
+// pick the delimiter which gives the most numeric rows (3 or more columns) in the first lines
+int magLogParser::detect(const char *buf, const char *end)
+{
+    const char candidates[]={',', '\t', ';', ' '};
+    double tmp[MAX_COLUMNS];
+    int best=0;
+
+    _delimiter = 0;
+    _columns = 0;
+    for(auto d:candidates)
+    {
+        int hit=0, columns=0;
+        const char *p=buf;
+        for(int line=0; line<DETECT_LINES && p<end; line++)
+        {
+            auto eol=nextLine(p,end);
+            int n=parseLine(p, eol, d, tmp, MAX_COLUMNS);
+            if(n>=3 && n<=MAX_COLUMNS)
+            {
+                if(columns==0) columns=n;
+                if(n==columns) hit++;
+            }
+            p=eol<end ? eol+1 : end;
+        }
+        if(hit>best)
+        {
+            best = hit;
+            _delimiter = d;
+            _columns = columns;
+        }
+    }
+    return best;
+}
+
+size_t magLogParser::parse(const char *buf, size_t length)
+{
+    _sets.clear();
+    _rejected = 0;
+    _rows = 0;
+
+    const char *end=buf+length;
+    if(!detect(buf,end)) return 0;
+
+    // split at line boundaries, a few chunks per thread for load balancing
+    std::vector<chunk> chunks;
+    size_t nChunk=std::max<size_t>(1, std::min<size_t>(length/MIN_CHUNK_SIZE, (size_t)_threads*4));
+    size_t step=length/nChunk;
+    const char *p=buf;
+    while(p<end)
+    {
+        chunk c;
+        c.begin = p;
+        c.end = (size_t)(end-p)>step ? nextLine(p+step,end) : end;
+        c.lines = 0;
+        c.rows = 0;
+        c.rejected = 0;
+        p = c.end<end ? c.end+1 : end;
+        chunks.push_back(c);
+    }
+
+    // every line may be a row, a chunk owns the rows from its first line on
+    parallel::forEach(chunks.size(), [&](size_t i, int)
+    {
+        chunk &c=chunks[i];
+        for(const char *q=c.begin; q<c.end; c.lines++)
+        {
+            auto eol=nextLine(q,c.end);
+            q=eol<c.end ? eol+1 : c.end;
+        }
+    }, _threads);
+    size_t lines=0;
+    for(auto &c:chunks)
+    {
+        c.pos = lines;
+        lines += c.lines;
+    }
+
+    const int columns=_columns;
+    const char delimiter=_delimiter;
+    const int nSensors=sensors();
+    _sets.resize(nSensors);
+    for(auto &d:_sets) d.resize(lines);
+
+    std::atomic<uint64_t> parsed(0);
+    std::atomic<bool> stop(false);
+    parallel::forEach(chunks.size(), [&](size_t i, int)
+    {
+        if(stop) return;
+        chunk &c=chunks[i];
+        double tmp[MAX_COLUMNS];
+        const char *p=c.begin;
+        while(p<c.end)
+        {
+            auto eol=nextLine(p,c.end);
+            int n=parseLine(p, eol, delimiter, tmp, MAX_COLUMNS);
+            if(n==columns && (columns==3 || std::isfinite(tmp[0])))     // from_chars takes "nan" and "inf", time must sort
+            {
+                // time is absolute here, the time base is subtracted when the chunks are joined
+                const size_t r=c.pos + c.rows++;
+                const int first = columns==3 ? 0 : 1;
+                for(int s=0;s<nSensors;s++)
+                {
+                    magDataSet &d=_sets[s];
+                    const double *v=tmp + first + 3*s;
+                    d.t()[r] = columns==3 ? 0.0 : tmp[0];
+                    d.x()[r] = v[0];
+                    d.y()[r] = v[1];
+                    d.z()[r] = v[2];
+                    d.w()[r] = std::sqrt(v[0]*v[0] + v[1]*v[1] + v[2]*v[2]);
+                }
+            }
+            else if(n>0)
+            {
+                c.rejected++;
+            }
+            p=eol<c.end ? eol+1 : c.end;
+        }
+
+        uint64_t current=parsed.fetch_add(c.end-c.begin)+(c.end-c.begin);
+        if(_progress && !_progress(current, length)) stop=true;
+    }, _threads);
+
+    if(stop)
+    {
+        _sets.clear();
+        return 0;
+    }
+
+    // close the gaps of the skipped lines, in order since a chunk moves into the space of the one before
+    size_t rows=0;
+    for(auto &c:chunks)
+    {
+        if(c.pos!=rows)
+        {
+            for(auto &d:_sets)
+            {
+                double *column[5]={d.t(), d.x(), d.y(), d.z(), d.w()};
+                for(auto v:column) std::memmove(v+rows, v+c.pos, c.rows*sizeof(double));
+            }
+        }
+        c.pos = rows;
+        rows += c.rows;
+        _rejected += c.rejected;
+    }
+    _rows = rows;
+
+    // time relative to the first row, the sample index without a time column
+    const double t0 = columns>3 && rows>0 ? _sets[0].t()[0] : 0.0;
+    parallel::forEach(chunks.size(), [&](size_t i, int)
+    {
+        const chunk &c=chunks[i];
+        for(auto &d:_sets)
+        {
+            double *t=d.t()+c.pos;
+            if(columns==3) for(size_t k=0;k<c.rows;k++) t[k] = (double)(c.pos+k);
+            else for(size_t k=0;k<c.rows;k++) t[k] -= t0;
+        }
+    }, _threads);
+    for(auto &d:_sets)
+    {
+        d.resize(rows);     // no reallocation, the lines which are not rows stay reserved
+        d.setTimeBase(t0);
+    }
+    return _rows;
+}
+
+int magLogParser::sensorsOf(int columns)
+{
+    if(columns>=7 && (columns-1)%3==0) return (columns-1)/3;
+    return columns>=3 ? 1 : 0;
+}
+
+magDataSet magLogParser::takeDataSet(int sensor)
+{
+    if(sensor<0 || (size_t)sensor>=_sets.size()) return magDataSet();
+    return std::move(_sets[sensor]);
+}
@@ -0,0 +1,88 @@
+#ifndef MAGLOGPARSER_H
+#define MAGLOGPARSER_H
+
+/*
+MIT License
+
+Copyright (c) 2021 WagonWheelRobotics
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+#include "magDataSet.h"
+
+// Text log parser (csv, tsv, space separated)
+// The numbers are converted in place by std::from_chars (see magLoader for the file mapping).
+// Delimiter and column count are detected once from the first rows,
+// rows which have a different column count are skipped.
+// The buffer is split at line boundaries and the chunks are parsed in parallel.
+// The lines of every chunk are counted first, a chunk writes its rows straight
+// into the columns of the datasets from its first line on, the gaps of skipped
+// lines are closed when all chunks are done. No row major copy of the log is made.
+// The progress callback is called from the worker threads after each chunk,
+// parsing stops (parse() returns 0) when it returns false.
+
+class magLogParser
+{
+public:
+    magLogParser(int threads=0);
+
+    size_t parse(const char *buf, size_t length);   // parse a memory block, returns number of rows
+    void setProgress(std::function<bool(uint64_t current, uint64_t total)> callback) {_progress=callback;}
+
+    char delimiter() const {return _delimiter;}     // ' ' means any blank
+    int columns() const {return _columns;}
+    int sensors() const {return sensorsOf(_columns);}
+    static int sensorsOf(int columns);      // t,x0,y0,z0,x1,y1,z1,... rows hold (columns-1)/3 sensors
+    size_t rows() const {return _rows;}
+    size_t rejected() const {return _rejected;}     // column count mismatch or a time which is not finite
+
+    magDataSet takeDataSet(int sensor=0);       // moves the columns of a sensor out of the parser
+
+    static int parseLine(const char *p, const char *eol, char delimiter, double *out, int maxColumns);
+
+private:
+    int detect(const char *buf, const char *end);
+
+private:
+    struct chunk
+    {
+        const char *begin;
+        const char *end;
+        size_t pos;         // first row in the datasets, the number of lines before the chunk
+        size_t lines;       // upper bound of the rows
+        size_t rows;
+        size_t rejected;
+    };
+
+    int _threads;
+    char _delimiter;
+    int _columns;
+    size_t _rejected;
+    size_t _rows;
+    std::vector<magDataSet> _sets;      // by sensor
+    std::function<bool(uint64_t, uint64_t)> _progress;
+};
+
+#endif // MAGLOGPARSER_H
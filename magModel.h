@@ -0,0 +1,253 @@
+#ifndef MAGMODEL_H
+#define MAGMODEL_H
+
+/*
+MIT License
+
+Copyright (c) 2021 WagonWheelRobotics
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#include <QString>
+#include <QStringList>
+#include <QVariantList>
+#include <QVariantMap>
+
+#include <cmath>
+#include <cstddef>
+#include <utility>
+
+#include "ellipsoidFit.h"
+
+// Calibration models
+//
+// A model is a struct with
+//   nParams                        number of parameters
+//   name(), description()          registry name and the model string of the exported file
+//   identity(k), initial(fit,k)    initial guesses (identity, closed-form ellipsoid fit)
+//   apply(k,x,y,z,cx,cy,cz)        raw -> corrected, templated for ceres::Jet
+//   gradient(k,x,y,z,sx,sy,sz,row) row[j] = sum_a s_a * d cor_a / d k_j
+//   toVariant(k)                   parameters for the exported file
+//
+// Everything is resolved at compile time, the solver and the apply loops are
+// instantiated once per model through magModelDispatch().
+
+// cor = k[0] * raw^2 + k[1] * raw + k[2], per axis
+struct magModelQuadratic
+{
+    enum {nParams=9};
+
+    static const char *name() {return "quadratic";}
+    static const char *description() {return "cor = k[0] x raw^2 + k[1] x raw + k[2]";}
+
+    static void identity(double *k)
+    {
+        const double i[nParams]={0.0,1.0,0.0, 0.0,1.0,0.0, 0.0,1.0,0.0};
+        for(int j=0;j<nParams;j++) k[j]=i[j];
+    }
+
+    static void initial(const ellipsoidFit &fit, double *k)
+    {
+        fit.quadratic(k);
+    }
+
+    template <typename T>
+    static inline void apply(const T *k, const T &x, const T &y, const T &z, T &cx, T &cy, T &cz)
+    {
+        cx = (k[0]*x + k[1])*x + k[2];
+        cy = (k[3]*y + k[4])*y + k[5];
+        cz = (k[6]*z + k[7])*z + k[8];
+    }
+
+    static inline void gradient(const double *, double x, double y, double z, double sx, double sy, double sz, double *row)
+    {
+        row[0] = sx*x*x;
+        row[1] = sx*x;
+        row[2] = sx;
+        row[3] = sy*y*y;
+        row[4] = sy*y;
+        row[5] = sy;
+        row[6] = sz*z*z;
+        row[7] = sz*z;
+        row[8] = sz;
+    }
+
+    static QVariantMap toVariant(const double *k)
+    {
+        QVariantMap m;
+        QVariantList x,y,z;
+        x << k[0] << k[1] << k[2];
+        y << k[3] << k[4] << k[5];
+        z << k[6] << k[7] << k[8];
+        m["kx"] = x;
+        m["ky"] = y;
+        m["kz"] = z;
+        return m;
+    }
+};
+
+// cor = W * raw + o, W: soft iron 3x3 (row major k[0..8]), o: offset k[9..11]
+// |cor| is invariant to a rotation of W, the solver adds a symmetry penalty to fix it
+struct magModelAffine
+{
+    enum {nParams=12};
+
+    static const char *name() {return "affine";}
+    static const char *description() {return "cor = W x raw + o";}
+
+    static void identity(double *k)
+    {
+        const double i[nParams]={1.0,0.0,0.0, 0.0,1.0,0.0, 0.0,0.0,1.0, 0.0,0.0,0.0};
+        for(int j=0;j<nParams;j++) k[j]=i[j];
+    }
+
+    static void initial(const ellipsoidFit &fit, double *k)
+    {
+        fit.affine(k);
+    }
+
+    template <typename T>
+    static inline void apply(const T *k, const T &x, const T &y, const T &z, T &cx, T &cy, T &cz)
+    {
+        cx = k[0]*x + k[1]*y + k[2]*z + k[9];
+        cy = k[3]*x + k[4]*y + k[5]*z + k[10];
+        cz = k[6]*x + k[7]*y + k[8]*z + k[11];
+    }
+
+    static inline void gradient(const double *, double x, double y, double z, double sx, double sy, double sz, double *row)
+    {
+        row[0] = sx*x;
+        row[1] = sx*y;
+        row[2] = sx*z;
+        row[3] = sy*x;
+        row[4] = sy*y;
+        row[5] = sy*z;
+        row[6] = sz*x;
+        row[7] = sz*y;
+        row[8] = sz*z;
+        row[9] = sx;
+        row[10] = sy;
+        row[11] = sz;
+    }
+
+    static QVariantMap toVariant(const double *k)
+    {
+        QVariantMap m;
+        QVariantList w,o;
+        for(int i=0;i<9;i++) w << k[i];
+        o << k[9] << k[10] << k[11];
+        m["W"] = w;
+        m["o"] = o;
+        return m;
+    }
+};
+
+// registry, the index in the list is the model id
+template <typename... M> struct magModelList {};
+typedef magModelList<magModelQuadratic, magModelAffine> magModels;
+
+#define MAG_MODEL_QUADRATIC 0
+#define MAG_MODEL_AFFINE    1
+
+template <typename F>
+inline int magModelDispatch(int, F &&, magModelList<>)
+{
+    return 0;
+}
+
+template <typename F, typename H, typename... R>
+inline int magModelDispatch(int model, F &&f, magModelList<H,R...>)
+{
+    if(model==0)
+    {
+        f(H());
+        return 1;
+    }
+    return magModelDispatch(model-1, std::forward<F>(f), magModelList<R...>());
+}
+
+// calls f(Model()) for the model id, 0 if the id is unknown
+template <typename F>
+inline int magModelDispatch(int model, F &&f)
+{
+    return magModelDispatch(model, std::forward<F>(f), magModels());
+}
+
+template <typename... M>
+inline QStringList magModelNames(magModelList<M...>)
+{
+    return QStringList{M::name()...};
+}
+
+inline QStringList magModelNames()
+{
+    return magModelNames(magModels());
+}
+
+inline int magModelFind(const QString &name)
+{
+    return magModelNames().indexOf(name);
+}
+
+inline int magModelParams(int model)
+{
+    int n=0;
+    magModelDispatch(model, [&](auto m){n=decltype(m)::nParams;});
+    return n;
+}
+
+// fields of the exported calibration file, empty if the model id is unknown
+inline QVariantMap magModelToVariant(int model, const double *k)
+{
+    QVariantMap m;
+    magModelDispatch(model, [&](auto mm)
+    {
+        typedef decltype(mm) M;
+        m = M::toVariant(k);
+        m["model"] = M::description();
+        m["name"] = M::name();
+    });
+    return m;
+}
+
+// cor = model(raw), n samples
+template <class M>
+inline void magModelApply(const double *k, const double *x, const double *y, const double *z, size_t n, double *cx, double *cy, double *cz)
+{
+    for(size_t i=0;i<n;i++) M::apply(k, x[i], y[i], z[i], cx[i], cy[i], cz[i]);
+}
+
+// sqrt(mean((|cor|-1)^2)), n samples
+template <class M>
+inline double magModelRms(const double *k, const double *x, const double *y, const double *z, size_t n)
+{
+    if(n==0) return 0.0;
+    double sum=0.0;
+    for(size_t i=0;i<n;i++)
+    {
+        double cx, cy, cz;
+        M::apply(k, x[i], y[i], z[i], cx, cy, cz);
+        const double e=std::sqrt(cx*cx + cy*cy + cz*cz) - 1.0;
+        sum += e*e;
+    }
+    return std::sqrt(sum/n);
+}
+
+#endif // MAGMODEL_H
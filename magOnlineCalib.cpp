@@ -0,0 +1,95 @@
+/*
+MIT License
+
+Copyright (c) 2021 WagonWheelRobotics
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#include "magOnlineCalib.h"
+
+#include <limits>
+
+#include "magDataSet.h"
+
+magOnlineCalib::magOnlineCalib(double lambda, size_t history)
+{
+    _lambda = lambda;
+    _t.resize(history);
+    _x.resize(history);
+    _y.resize(history);
+    _z.resize(history);
+    reset();
+}
+
+void magOnlineCalib::reset(void)
+{
+    _fit = ellipsoidFit();
+    _count = 0;
+    _head = 0;
+}
+
+void magOnlineCalib::add(double t, double x, double y, double z)
+{
+    if(_lambda<1.0) _fit.decay(_lambda);
+    _fit.add(x, y, z);
+    _count++;
+
+    if(!_t.empty())
+    {
+        _t[_head] = t;
+        _x[_head] = x;
+        _y[_head] = y;
+        _z[_head] = z;
+        _head = (_head+1)%_t.size();
+    }
+}
+
+int magOnlineCalib::estimate(int model, QVector<double> &k) const
+{
+    k.clear();
+    ellipsoidFit fit(_fit);
+    if(!fit.solve()) return 0;
+
+    return magModelDispatch(model, [&](auto m)
+    {
+        typedef decltype(m) M;
+        k.resize(M::nParams);
+        M::initial(fit, k.data());
+    });
+}
+
+int magOnlineCalib::refine(int model, QVector<double> &k, const solverOptions &options) const
+{
+    const size_t n=std::min(_count, _t.size());
+    if(n==0) return 0;
+
+    // oldest first
+    magDataSet d;
+    d.reserve(n);
+    const size_t first=(_head + _t.size() - n)%_t.size();
+    for(size_t i=0;i<n;i++)
+    {
+        const size_t j=(first+i)%_t.size();
+        d.append(_t[j], _x[j], _y[j], _z[j]);
+    }
+
+    const double inf=std::numeric_limits<double>::infinity();
+    return solve(d.span(), -inf, inf, k, model, 0, options);
+}
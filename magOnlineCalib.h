@@ -0,0 +1,73 @@
+#ifndef MAGONLINECALIB_H
+#define MAGONLINECALIB_H
+
+/*
+MIT License
+
+Copyright (c) 2021 WagonWheelRobotics
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#include <QVector>
+
+#include <cstddef>
+#include <vector>
+
+#include "ellipsoidFit.h"
+#include "solver.h"
+
+// Incremental calibration of a sample stream
+//
+// Every sample updates the ellipsoid scatter matrix, optionally with exponential
+// forgetting (S = lambda*S + d*d^T), in constant time. estimate() solves the
+// 10x10 scatter, which does not depend on the number of samples seen, so it can be
+// polled at any time. refine() runs the nonlinear solver on the most recent
+// samples only, seeded by the closed-form fit.
+// With forgetting the fit remembers about 1/(1-lambda) samples, 9 at least are needed.
+//
+// Not thread safe, add() and the queries must be called from the same thread.
+
+#define MAG_ONLINE_HISTORY  20000   // samples kept for refine()
+
+class magOnlineCalib
+{
+public:
+    explicit magOnlineCalib(double lambda=1.0, size_t history=MAG_ONLINE_HISTORY);
+
+    void reset(void);
+    void add(double t, double x, double y, double z);
+
+    size_t count() const {return _count;}
+    double lambda() const {return _lambda;}
+
+    int estimate(int model, QVector<double> &k) const;
+    int refine(int model, QVector<double> &k, const solverOptions &options=solverOptions()) const;
+
+private:
+    ellipsoidFit _fit;
+    double _lambda;
+    size_t _count;
+
+    // ring buffer of the last samples
+    std::vector<double> _t, _x, _y, _z;
+    size_t _head;
+};
+
+#endif // MAGONLINECALIB_H
@@ -0,0 +1,446 @@
+/*
+MIT License
+
+Copyright (c) 2021 WagonWheelRobotics
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#include "magReplay.h"
+
+#include <QCommandLineParser>
+#include <QFileInfo>
+#include <QHostAddress>
+#include <QTcpServer>
+#include <QTcpSocket>
+#include <QTextStream>
+#include <QDebug>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <thread>
+
+#ifdef Q_OS_UNIX
+#include <cerrno>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <termios.h>
+#include <unistd.h>
+#endif
+
+#include "magLoader.h"
+#include "magStream.h"
+
+#define REPLAY_PORT         10000
+#define REPLAY_CHUNK        (64<<10)    // bytes per write
+#define REPLAY_BACKLOG      (256<<10)   // TCP: unsent bytes before waiting for the receiver
+#define REPLAY_SLEEP_MAX_US 10000       // longest sleep, keeps the stats line on time
+#define REPLAY_FRAME_SAMPLES 16         // cobs framing, samples per frame
+#define REPLAY_WIRE_ROUNDING 1e-3       // cobs framing, largest rounding of a scaled value, counts
+
+typedef std::chrono::steady_clock replayClock;
+
+class replaySink
+{
+public:
+    virtual ~replaySink() {}
+    virtual bool write(const char *p, size_t n)=0;      // blocks while the receiver is behind
+};
+
+class tcpSink : public replaySink
+{
+public:
+    explicit tcpSink(QTcpSocket *socket) : _socket(socket)
+    {
+    }
+
+    virtual bool write(const char *p, size_t n)
+    {
+        if(_socket->write(p, (qint64)n)!=(qint64)n) return false;
+        _socket->flush();
+        while(_socket->bytesToWrite()>REPLAY_BACKLOG)
+        {
+            if(_socket->state()!=QAbstractSocket::ConnectedState) return false;
+            _socket->waitForBytesWritten(100);
+        }
+        return _socket->state()==QAbstractSocket::ConnectedState;
+    }
+
+private:
+    QTcpSocket *_socket;
+};
+
+#ifdef Q_OS_UNIX
+// master side of a pseudo terminal, the slave is raw so the rows pass unchanged
+class ptySink : public replaySink
+{
+public:
+    ptySink()
+    {
+        _fd = posix_openpt(O_RDWR|O_NOCTTY);
+        if(_fd<0) return;
+        if(grantpt(_fd)!=0 || unlockpt(_fd)!=0)
+        {
+            ::close(_fd);
+            _fd = -1;
+            return;
+        }
+        _name = ptsname(_fd);
+
+        int slave=::open(_name.toLocal8Bit().constData(), O_RDWR|O_NOCTTY);
+        if(slave>=0)
+        {
+            termios tio;
+            if(tcgetattr(slave, &tio)==0)
+            {
+                cfmakeraw(&tio);
+                tcsetattr(slave, TCSANOW, &tio);
+            }
+            ::close(slave);
+        }
+    }
+
+    virtual ~ptySink()
+    {
+        if(_fd>=0) ::close(_fd);
+    }
+
+    bool isOpen() const {return _fd>=0;}
+    const QString &name() const {return _name;}
+
+    virtual bool write(const char *p, size_t n)
+    {
+        while(n)
+        {
+            const ssize_t r=::write(_fd, p, n);
+            if(r<0)
+            {
+                if(errno==EINTR || errno==EAGAIN) continue;
+                return false;
+            }
+            p += r;
+            n -= (size_t)r;
+        }
+        return true;
+    }
+
+private:
+    int _fd;
+    QString _name;
+};
+#endif
+
+typedef struct
+{
+    double speed;           // 0: as fast as possible
+    double rate;            // > 0: replaces the time stamps, Hz
+    int stamp;
+    int framing;            // MAG_STREAM_FRAMING_*
+    int frameSamples;       // cobs framing, samples per frame
+    double wireScale;       // cobs framing, sensor counts per log unit
+    bool loop;
+} replayJob_t;
+
+// cobs frames carry integer sensor counts, the scaled log has to be integer and fit int32
+static bool wireCountsExact(const magDataSet &data, double scale, QString &why)
+{
+    const double *c[3]={data.x(), data.y(), data.z()};
+    for(size_t i=0;i<data.size();i++)
+    {
+        for(int k=0;k<3;k++)
+        {
+            const double v=c[k][i]*scale;
+            if(!(std::abs(v)<=(double)INT32_MAX))
+            {
+                why = QString("row %1: %2 does not fit in int32 sensor counts").arg(i+1).arg(v);
+                return false;
+            }
+            if(std::abs(v-std::nearbyint(v))>REPLAY_WIRE_ROUNDING)
+            {
+                why = QString("row %1: %2 is not an integer sensor count").arg(i+1).arg(v, 0, 'g', 9);
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+static double wallClock(void)
+{
+    return std::chrono::duration<double>(std::chrono::system_clock::now().time_since_epoch()).count();
+}
+
+// returns false when the receiver is gone
+static bool replay(const magDataSet &data, const replayJob_t &job, replaySink &sink, QTextStream &out)
+{
+    const size_t n=data.size();
+    const double *t=data.t();
+    const double *x=data.x();
+    const double *y=data.y();
+    const double *z=data.z();
+    const double dt = job.rate>0.0 ? 1.0/job.rate : (n>1 ? (t[n-1]-t[0])/(n-1) : 0.0);
+    const double span = job.rate>0.0 ? n*dt : (n>0 ? t[n-1]-t[0]+dt : 0.0);
+
+    std::string buf;
+    buf.reserve(REPLAY_CHUNK+MAG_WIRE_MAX_ENCODED);
+    auto flush=[&]()
+    {
+        const bool ok = buf.empty() || sink.write(buf.data(), buf.size());
+        buf.clear();
+        return ok;
+    };
+
+    // cobs framing: samples are collected into a frame, interval is the mean of the block
+    magWireFrame frame;
+    frame.sensor = 0;
+    frame.sequence = 0;
+    frame.count = 0;
+    frame.wide = 0;
+    double frameFirst=0.0, frameLast=0.0;
+    uint64_t bytes=0;
+    auto pack=[&]()
+    {
+        if(frame.count==0) return;
+        frame.t0 = (uint64_t)std::llround(frameFirst*1e6);
+        frame.dt = frame.count>1 ? (uint32_t)std::llround((frameLast-frameFirst)*1e6/(frame.count-1)) : 0;
+        uint8_t encoded[MAG_WIRE_MAX_ENCODED];
+        const size_t len=magWireEncode(frame, encoded);
+        buf.append((const char*)encoded, len);
+        bytes += len;
+        frame.sequence++;
+        frame.count = 0;
+        frame.wide = 0;
+    };
+
+    const auto start=replayClock::now();
+    auto report=start;
+    uint64_t rows=0, lastRows=0, lastBytes=0;
+    double lag=0.0;
+    bool ok=true;
+    for(int pass=0; ok && (pass==0 || job.loop); pass++)
+    {
+        for(size_t i=0; ok && i<n; i++)
+        {
+            const double ti = pass*span + (job.rate>0.0 ? i*dt : t[i]-t[0]);
+            auto now=replayClock::now();
+            if(job.speed>0.0)
+            {
+                // rows which are due go out together, sleep until the next one
+                const double target=ti/job.speed;
+                double elapsed=std::chrono::duration<double>(now-start).count();
+                if(target>elapsed)
+                {
+                    ok = flush();
+                    while(ok && target>elapsed)
+                    {
+                        const double us=std::min((target-elapsed)*1e6, (double)REPLAY_SLEEP_MAX_US);
+                        std::this_thread::sleep_for(std::chrono::microseconds((long long)us));
+                        now = replayClock::now();
+                        elapsed = std::chrono::duration<double>(now-start).count();
+                    }
+                }
+                else
+                {
+                    lag = std::max(lag, elapsed-target);
+                }
+            }
+
+            const double ts = job.stamp ? wallClock() : data.timeBase()+ti;
+            if(job.framing==MAG_STREAM_FRAMING_COBS)
+            {
+                const double s=job.wireScale;
+                const long long v[3]={std::llround(x[i]*s), std::llround(y[i]*s), std::llround(z[i]*s)};
+                if(frame.count==0) frameFirst = ts;
+                frameLast = ts;
+                for(int k=0;k<3;k++)
+                {
+                    frame.xyz[3*frame.count+k] = (int32_t)v[k];
+                    if(v[k]<INT16_MIN || v[k]>INT16_MAX) frame.wide = 1;
+                }
+                if(++frame.count==job.frameSamples) pack();
+            }
+            else
+            {
+                char row[160];
+                const int len=std::snprintf(row, sizeof(row), "%.6f,%.9g,%.9g,%.9g", ts, x[i], y[i], z[i]);
+                if(job.framing==MAG_STREAM_FRAMING_LENGTH)
+                {
+                    buf.push_back((char)(len&0xff));
+                    buf.push_back((char)(len>>8));
+                    buf.append(row, len);
+                }
+                else
+                {
+                    buf.append(row, len);
+                    buf.push_back('\n');
+                }
+                bytes += len + (job.framing==MAG_STREAM_FRAMING_LENGTH ? 2 : 1);
+            }
+            rows++;
+            if(buf.size()>=REPLAY_CHUNK) ok = flush();
+
+            const double sec=std::chrono::duration<double>(now-report).count();
+            if(sec>=1.0)
+            {
+                out << QString("%1 rows/s, %2 MB/s, lag %3 ms").arg((rows-lastRows)/sec, 0, 'f', 0)
+                                                               .arg((bytes-lastBytes)/sec*1e-6, 0, 'f', 2)
+                                                               .arg(lag*1e3, 0, 'f', 1) << "\n";
+                out.flush();
+                report = now;
+                lastRows = rows;
+                lastBytes = bytes;
+                lag = 0.0;
+            }
+        }
+    }
+    pack();
+    if(ok) ok = flush();
+
+    const double sec=std::chrono::duration<double>(replayClock::now()-start).count();
+    out << rows << " rows, " << bytes << " bytes in " << sec << " s, " << QString::number(rows/sec, 'f', 0) << " rows/s"
+        << (ok ? "" : ", receiver is gone") << "\n";
+    out.flush();
+    return ok;
+}
+
+bool magReplayRequested(int argc, char *argv[])
+{
+    for(int i=1;i<argc;i++)
+    {
+        if(std::strcmp(argv[i],"--replay")==0) return true;
+    }
+    return false;
+}
+
+int magReplay(const QStringList &arguments)
+{
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Log replay server");
+    parser.addHelpOption();
+    parser.addPositionalArgument("file", "Log file.", "<file>");
+    parser.addOptions({
+        {"replay", "Replay mode."},
+        {{"p","port"}, "TCP port on 127.0.0.1.", "port", QString::number(REPLAY_PORT)},
+        {"pty", "Serve on a pseudo terminal instead of TCP (unix)."},
+        {{"s","speed"}, "Time scale, 2: twice as fast, 0: as fast as possible.", "x", "1"},
+        {"rate", "Send at this sample rate instead of the time stamps of the log.", "hz"},
+        {"stamp", "Time column is the wall clock at sending (latency measurement)."},
+        {"framing", "newline, length (uint16 LE length prefix) or cobs (binary frames).", "framing", "newline"},
+        {"frame-samples", "Samples per binary frame.", "n", QString::number(REPLAY_FRAME_SAMPLES)},
+        {"wire-scale", "Binary frames: sensor counts per log unit, the scaled log must be integer.", "k", "1"},
+        {"loop", "Repeat the log."},
+        {"once", "Exit after the first client."},
+    });
+    parser.process(arguments);
+
+    if(parser.positionalArguments().size()!=1)
+    {
+        qWarning()<<"One log file is needed";
+        return 2;
+    }
+    const QString fileName=parser.positionalArguments().front();
+
+    replayJob_t job;
+    job.speed = std::max(0.0, parser.value("speed").toDouble());
+    job.rate = parser.isSet("rate") ? std::max(0.0, parser.value("rate").toDouble()) : 0.0;
+    job.stamp = parser.isSet("stamp") ? 1 : 0;
+    job.loop = parser.isSet("loop");
+    job.frameSamples = std::min(std::max(1, parser.value("frame-samples").toInt()), MAG_WIRE_MAX_SAMPLES);
+    job.wireScale = parser.value("wire-scale").toDouble();
+    if(!(job.wireScale>0.0))
+    {
+        qWarning()<<"Wire scale must be positive";
+        return 2;
+    }
+    if(parser.value("framing")=="length") job.framing = MAG_STREAM_FRAMING_LENGTH;
+    else if(parser.value("framing")=="newline") job.framing = MAG_STREAM_FRAMING_NEWLINE;
+    else if(parser.value("framing")=="cobs") job.framing = MAG_STREAM_FRAMING_COBS;
+    else
+    {
+        qWarning()<<"Unknown framing"<<parser.value("framing");
+        return 2;
+    }
+
+    magLoader loader;
+    magDataSet data;
+    if(!loader.load(fileName, data) || data.empty())
+    {
+        qWarning()<<fileName<<"is not loaded";
+        return 1;
+    }
+
+    QString why;
+    if(job.framing==MAG_STREAM_FRAMING_COBS && !wireCountsExact(data, job.wireScale, why))
+    {
+        qWarning().noquote()<<"Binary frames carry integer sensor counts,"<<why<<"(--wire-scale"<<job.wireScale<<")."
+                            <<"Use --wire-scale to convert the log units, or text framing.";
+        return 2;
+    }
+
+    QTextStream out(stdout);
+    out << QFileInfo(fileName).fileName() << ": " << data.size() << " samples, " << data.back()-data.front() << " s" << "\n";
+
+    if(parser.isSet("pty"))
+    {
+#ifdef Q_OS_UNIX
+        ptySink pty;
+        if(!pty.isOpen())
+        {
+            qWarning()<<"Can not open a pseudo terminal";
+            return 1;
+        }
+        out << "Serving on " << pty.name() << "\n";
+        out.flush();
+        return replay(data, job, pty, out) ? 0 : 1;
+#else
+        qWarning()<<"Pseudo terminals are not supported on this platform";
+        return 2;
+#endif
+    }
+
+    QTcpServer server;
+    if(!server.listen(QHostAddress::LocalHost, (quint16)parser.value("port").toUInt()))
+    {
+        qWarning()<<"Can not listen:"<<server.errorString();
+        return 1;
+    }
+    out << "Listening on 127.0.0.1:" << server.serverPort() << "\n";
+    out.flush();
+
+    for(;;)
+    {
+        if(!server.waitForNewConnection(-1)) break;
+        std::unique_ptr<QTcpSocket> socket(server.nextPendingConnection());
+        socket->setSocketOption(QAbstractSocket::LowDelayOption, 1);
+        out << "Client " << socket->peerAddress().toString() << ":" << socket->peerPort() << "\n";
+        out.flush();
+
+        tcpSink sink(socket.get());
+        replay(data, job, sink, out);
+        socket->disconnectFromHost();
+        if(socket->state()!=QAbstractSocket::UnconnectedState) socket->waitForDisconnected(1000);
+        if(parser.isSet("once")) break;
+    }
+    return 0;
+}
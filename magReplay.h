@@ -0,0 +1,47 @@
+#ifndef MAGREPLAY_H
+#define MAGREPLAY_H
+
+/*
+MIT License
+
+Copyright (c) 2021 WagonWheelRobotics
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#include <QStringList>
+
+// Log replay server, a stand-in for the sensor when testing the live pipeline
+//
+//   magCal --replay [options] <log file>
+//
+// The samples of the log are sent as text rows (t,x,y,z) by a local TCP server
+// (one client at a time, see TCP Client) or by a pseudo terminal (--pty, unix only,
+// open the printed device as the serial port). The time stamps of the log are
+// honored, scaled by --speed, --speed 0 sends as fast as the receiver reads.
+// --stamp replaces the time by the sender's wall clock, the live view shows the
+// end-to-end latency of such a stream. Rate and lag behind the schedule are printed
+// every second. Only QCoreApplication is needed, no display.
+// Binary frames (--framing cobs) carry integer sensor counts: the log values times
+// --wire-scale must be integers, a log in other units is refused.
+
+bool magReplayRequested(int argc, char *argv[]);
+int magReplay(const QStringList &arguments);
+
+#endif // MAGREPLAY_H
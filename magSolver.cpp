@@ -0,0 +1,116 @@
+/*
+MIT License
+
+Copyright (c) 2021 WagonWheelRobotics
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#include "magSolver.h"
+
+#include <QThread>
+#include <QDebug>
+#include <QElapsedTimer>
+
+#include <algorithm>
+#include <atomic>
+
+magSolver::magSolver(std::shared_ptr<const magDataSet> data, double t0, double t1, int model, int fastMode, const solverOptions &options, QObject *parent) : QObject(parent)
+{
+    _dataSet = data;
+    _data = _dataSet->span();
+    _t0 = t0;
+    _t1 = t1;
+    _model = model;
+    _fastMode = fastMode;
+    _options = options;
+    _width = 0.0;
+    _stride = 0.0;
+    _resampleMode = SOLVER_RESAMPLE_BOOTSTRAP;
+    _resampleCount = 0;
+    _cacheEnabled = true;
+    _dataHash = 0;
+    _cancel = false;
+    _result = 0;
+}
+
+magSolver::~magSolver()
+{
+
+}
+
+// the sweep and the resampling report every window, from several threads;
+// the queued progress signal is emitted at 1% steps only, the cancel check stays per window
+static bool percentStep(std::atomic<int> &last, size_t current, size_t total)
+{
+    const int p = total>0 ? (int)(std::min(current, total)*100/total) : 100;
+    int l=last.load();
+    while(p>l)
+    {
+        if(last.compare_exchange_weak(l, p)) return true;
+    }
+    return false;
+}
+
+void magSolver::run(void)
+{
+    thread()->setPriority(QThread::LowPriority);
+    std::atomic<int> percent(-1);
+    if(isSweep())
+    {
+        QElapsedTimer timer;
+        timer.start();
+        _result = solveSweep(_data, _t0, _t1, _width, _stride, _model, _options, _windows, [&](size_t current, size_t total)
+        {
+            if(percentStep(percent, current, total)) emit progress(current, total);
+            return !_cancel;
+        });
+        if(_result) qInfo()<<_windows.size()<<"windows are solved in"<<timer.elapsed()<<"ms";
+        else if(_cancel) qInfo()<<"Sliding window calibration is canceled.";
+        emit done(this);
+        return;
+    }
+    if(isResample())
+    {
+        QElapsedTimer timer;
+        timer.start();
+        _result = solveResample(_data, _t0, _t1, _model, _resampleMode, _resampleCount, _options, _resample, [&](size_t current, size_t total)
+        {
+            if(percentStep(percent, current, total)) emit progress(current, total);
+            return !_cancel;
+        });
+        if(_result) qInfo()<<_resample.solved<<"of"<<_resampleCount<<"resamples are solved in"<<timer.elapsed()<<"ms";
+        else if(_cancel) qInfo()<<"Resampling is canceled.";
+        emit done(this);
+        return;
+    }
+
+    auto callback=[=](int i, double cost, double gradientNorm)
+    {
+        emit iteration(i, cost, gradientNorm);
+        return !_cancel;
+    };
+    if(_cacheEnabled) _result = solveCached(_data, _t0, _t1, _k, _model, _fastMode, _options, callback, &_report, &_dataHash);
+    else _result = solve(_data, _t0, _t1, _k, _model, _fastMode, _options, callback, QVector<double>(), &_report);
+    if(_cancel)
+    {
+        qInfo()<<"Solving is canceled, the parameters of the last iteration are kept.";
+    }
+    emit done(this);
+}
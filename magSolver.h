@@ -0,0 +1,107 @@
+#ifndef MAGSOLVER_H
+#define MAGSOLVER_H
+
+/*
+MIT License
+
+Copyright (c) 2021 WagonWheelRobotics
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#include <QObject>
+#include <QVector>
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include "solver.h"
+#include "solverCache.h"
+#include "solverResample.h"
+
+// Runs solve() on a worker thread.
+// Move the solver to a worker thread and invoke run(), iteration() is emitted
+// for every solver iteration and done() when finished. cancel() may be called
+// from any thread, the parameters of the last successful iteration are kept.
+// The solver shares the dataset, replacing it in the caller does not affect a running solve.
+// With setSweep(), run() solves sliding windows (solveSweep) instead of one range.
+// With setResample(), run() solves bootstrap or k-fold resamples (solveResample).
+// A single range is solved through the result cache (solveCached) unless it is disabled.
+
+class magSolver : public QObject
+{
+    Q_OBJECT
+public:
+    magSolver(std::shared_ptr<const magDataSet> data, double t0, double t1, int model, int fastMode, const solverOptions &options, QObject *parent=nullptr);
+    virtual ~magSolver();
+
+    void setSweep(double width, double stride) {_width=width; _stride=stride;}
+    bool isSweep() const {return _width>0.0;}
+    void setResample(int mode, int count) {_resampleMode=mode; _resampleCount=count;}
+    bool isResample() const {return _resampleCount>0;}
+    void setCacheEnabled(bool enabled) {_cacheEnabled=enabled;}
+    void setDataHash(uint64_t hash) {_dataHash=hash;}     // solverCache::hashOf() of the data, 0: unknown
+    uint64_t dataHash() const {return _dataHash;}        // known after a cached run
+
+    void cancel(void) {_cancel=true;}
+    bool isCanceled(void) const {return _cancel;}
+
+    int result() const {return _result;}
+    double t0() const {return _t0;}
+    double t1() const {return _t1;}
+    int model() const {return _model;}
+    const QVector<double> &k() const {return _k;}
+    const solverReport &report() const {return _report;}
+    const solverResample &resample() const {return _resample;}
+    const std::vector<solverWindow> &windows() const {return _windows;}
+
+public slots:
+    void run(void);     // worker thread
+
+signals:
+    void iteration(int iteration, double cost, double gradientNorm);
+    void progress(quint64 current, quint64 total);
+    void done(QObject *x);
+
+private:
+    std::shared_ptr<const magDataSet> _dataSet;
+    magDataSpan _data;      // of _dataSet
+    double _t0;
+    double _t1;
+    int _model;
+    int _fastMode;
+    solverOptions _options;
+    double _width;
+    double _stride;
+    int _resampleMode;
+    int _resampleCount;
+    bool _cacheEnabled;
+    uint64_t _dataHash;
+
+    std::atomic<bool> _cancel;
+    int _result;
+    QVector<double> _k;
+    solverReport _report;
+    solverResample _resample;
+    std::vector<solverWindow> _windows;
+};
+
+#endif // MAGSOLVER_H
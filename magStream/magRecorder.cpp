@@ -0,0 +1,331 @@
+/*
+MIT License
+
+Copyright (c) 2021 WagonWheelRobotics
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#include "magRecorder.h"
+
+#include <QFile>
+#include <QFileInfo>
+#include <QSysInfo>
+#include <QDebug>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <string>
+
+#include "magBin.h"
+#include "magDataSet.h"
+
+#define MAG_RECORD_POP          8192        // samples taken from the ring at once
+
+static inline uint64_t alignUp(uint64_t x)
+{
+    return (x+MAG_RECORD_ALIGN-1) & ~(uint64_t)(MAG_RECORD_ALIGN-1);
+}
+
+struct magRecorder::segment
+{
+    QFile file;
+    int sensor;
+    int index;          // rolling file number
+    size_t rows;        // in this file, written or not
+    bool ok;
+
+    // csv: text which is not written, pos is the file size
+    std::string text;
+    qint64 pos;
+
+    // magbin: the last rows of the columns which are not written
+    double timeBase;
+    magColumn column[5];
+    size_t batch;
+    uint64_t offset[5];
+};
+
+magRecorder::magRecorder(const QString &fileName, int format) : _ring(MAG_RECORD_SAMPLES)
+{
+    _fileName = fileName;
+    _format = format;
+    _running = false;
+    _written = 0;
+    _bytes = 0;
+    _lost = 0;
+    _failed = false;
+}
+
+magRecorder::~magRecorder()
+{
+    stop();
+}
+
+int magRecorder::formatOf(const QString &fileName)
+{
+    return fileName.endsWith(".magbin", Qt::CaseInsensitive) ? MAG_RECORD_MAGBIN : MAG_RECORD_CSV;
+}
+
+void magRecorder::start(void)
+{
+    if(_writer.joinable()) return;
+
+    // magbin columns are raw little endian values like the cache
+    if(_format==MAG_RECORD_MAGBIN && QSysInfo::ByteOrder!=QSysInfo::LittleEndian)
+    {
+        qWarning()<<"magbin recording needs a little endian host";
+        _failed = true;
+    }
+    _running = true;
+    _writer = std::thread([this](){run();});
+}
+
+void magRecorder::stop(void)
+{
+    if(!_writer.joinable()) return;
+    _running = false;
+    _writer.join();
+}
+
+void magRecorder::push(const magStreamSample *s, size_t n)
+{
+    if(!_ring.push(s, n)) _lost += n;
+}
+
+void magRecorder::run(void)
+{
+    std::vector<magStreamSample> buf(MAG_RECORD_POP);
+    for(;;)
+    {
+        // read before the ring, the samples pushed before stop() are all taken
+        const bool running=_running;
+        const size_t n=_ring.pop(buf.data(), buf.size());
+        for(size_t i=0;i<n;i++) add(buf[i]);
+        if(n==0)
+        {
+            if(!running) break;
+            std::this_thread::sleep_for(std::chrono::milliseconds(MAG_RECORD_IDLE_MS));
+        }
+    }
+
+    for(auto &f:_segments)
+    {
+        if(f && f->file.isOpen()) close(*f);
+    }
+    _segments.clear();
+}
+
+void magRecorder::add(const magStreamSample &s)
+{
+    if(_failed || s.sensor<0)
+    {
+        _lost++;
+        return;
+    }
+
+    if((size_t)s.sensor>=_segments.size()) _segments.resize(s.sensor+1);
+    auto &p=_segments[s.sensor];
+    if(!p)
+    {
+        p.reset(new segment);
+        p->sensor = s.sensor;
+        p->index = -1;
+    }
+    segment &f=*p;
+
+    if(!f.file.isOpen() || f.rows==MAG_RECORD_SEGMENT)
+    {
+        if(f.file.isOpen() && !close(f))
+        {
+            _lost++;
+            return;
+        }
+        f.index++;
+        f.timeBase = s.t;
+        if(!open(f))
+        {
+            _lost++;
+            return;
+        }
+    }
+
+    if(_format==MAG_RECORD_MAGBIN)
+    {
+        const size_t i=f.batch++;
+        f.column[0][i] = s.t - f.timeBase;
+        f.column[1][i] = s.x;
+        f.column[2][i] = s.y;
+        f.column[3][i] = s.z;
+        f.column[4][i] = std::sqrt(s.x*s.x + s.y*s.y + s.z*s.z);
+        f.rows++;
+        if(f.batch==MAG_RECORD_BATCH) writeBatch(f);
+    }
+    else
+    {
+        char row[160];
+        const int len=std::snprintf(row, sizeof(row), "%.6f,%.9g,%.9g,%.9g\n", s.t, s.x, s.y, s.z);
+        f.text.append(row, len);
+        f.rows++;
+        if(f.text.size()>=MAG_RECORD_BLOCK) writeText(f, false);
+    }
+    _written++;
+}
+
+QString magRecorder::segmentName(int sensor, int index) const
+{
+    const QFileInfo fi(_fileName);
+    QString name=fi.path() + "/" + fi.completeBaseName();
+    if(sensor>0) name += QString("-s%1").arg(sensor);
+    name += QString("-%1").arg(index, 3, 10, QChar('0'));
+    if(!fi.suffix().isEmpty()) name += "." + fi.suffix();
+    return name;
+}
+
+bool magRecorder::open(segment &f)
+{
+    f.file.setFileName(segmentName(f.sensor, f.index));
+    f.rows = 0;
+    f.ok = true;
+    f.text.clear();
+    f.pos = 0;
+    f.batch = 0;
+
+    if(!f.file.open(QIODevice::ReadWrite | QIODevice::Truncate | QIODevice::Unbuffered))
+    {
+        qWarning()<<"Can not open"<<f.file.fileName();
+        _failed = true;
+        return false;
+    }
+
+    if(_format==MAG_RECORD_MAGBIN)
+    {
+        // the header block, then a full segment of every column
+        for(int i=0;i<5;i++)
+        {
+            f.offset[i] = i==0 ? alignUp(MAGBIN_HEADER_SIZE) : alignUp(f.offset[i-1] + MAG_RECORD_SEGMENT*sizeof(double));
+            f.column[i].resize(MAG_RECORD_BATCH);
+        }
+        uint8_t header[MAGBIN_HEADER_SIZE];
+        const magbin_source_t none={0, 0};
+        magbin_header(header, 0, f.timeBase, 4, MAGBIN_TYPE_DOUBLE, none, f.offset);
+        if(!write(f, 0, (const char*)header, sizeof(header))) return false;
+    }
+    else
+    {
+        f.text.reserve(MAG_RECORD_BLOCK + MAG_RECORD_ALIGN);
+    }
+    return true;
+}
+
+bool magRecorder::close(segment &f)
+{
+    if(_format==MAG_RECORD_MAGBIN)
+    {
+        if(f.ok && f.batch>0) writeBatch(f);
+        if(f.ok && f.rows<MAG_RECORD_SEGMENT) compact(f);
+        if(f.ok)
+        {
+            uint8_t header[MAGBIN_HEADER_SIZE];
+            const magbin_source_t none={0, 0};
+            magbin_header(header, f.rows, f.timeBase, 4, MAGBIN_TYPE_DOUBLE, none, f.offset);
+            write(f, 0, (const char*)header, sizeof(header));
+        }
+    }
+    else
+    {
+        if(f.ok) writeText(f, true);
+    }
+
+    f.file.close();
+    if(f.ok) qInfo()<<"Recorded"<<f.rows<<"samples to"<<f.file.fileName();
+    return f.ok;
+}
+
+// whole MAG_RECORD_ALIGN blocks, the rest stays for the next write unless all
+bool magRecorder::writeText(segment &f, bool all)
+{
+    const size_t n = all ? f.text.size() : f.text.size() & ~(size_t)(MAG_RECORD_ALIGN-1);
+    if(n==0) return true;
+    if(!write(f, f.pos, f.text.data(), (qint64)n)) return false;
+    f.pos += n;
+    f.text.erase(0, n);
+    return true;
+}
+
+// the batch of every column goes to its place in the column, one block each
+bool magRecorder::writeBatch(segment &f)
+{
+    const uint64_t first=f.rows - f.batch;
+    for(int i=0;i<5;i++)
+    {
+        if(!write(f, f.offset[i] + first*sizeof(double), (const char*)f.column[i].data(), f.batch*sizeof(double))) return false;
+    }
+    f.batch = 0;
+    return true;
+}
+
+// moves the columns of a short segment next to each other, forward copy is safe
+// since every column only moves towards the start of the file
+bool magRecorder::compact(segment &f)
+{
+    const uint64_t size=f.rows*sizeof(double);
+    std::vector<char> buf(MAG_RECORD_BATCH*sizeof(double));
+    for(int i=1;i<5;i++)
+    {
+        const uint64_t to=alignUp(f.offset[i-1] + size);
+        for(uint64_t pos=0;pos<size;pos+=buf.size())
+        {
+            const qint64 n=(qint64)std::min<uint64_t>(buf.size(), size-pos);
+            if(!f.file.seek(f.offset[i]+pos) || f.file.read(buf.data(), n)!=n)
+            {
+                qWarning()<<"Can not read"<<f.file.fileName();
+                f.ok = false;
+                _failed = true;
+                return false;
+            }
+            if(!write(f, to+pos, buf.data(), n)) return false;
+        }
+        f.offset[i] = to;
+    }
+    if(!f.file.resize(f.offset[4] + size))
+    {
+        qWarning()<<"Can not resize"<<f.file.fileName();
+        f.ok = false;
+        _failed = true;
+        return false;
+    }
+    return true;
+}
+
+bool magRecorder::write(segment &f, qint64 pos, const char *p, qint64 n)
+{
+    if(!f.file.seek(pos) || f.file.write(p, n)!=n)
+    {
+        qWarning()<<"Can not write"<<f.file.fileName()<<f.file.errorString();
+        f.ok = false;
+        _failed = true;
+        return false;
+    }
+    _bytes += (uint64_t)n;
+    return true;
+}
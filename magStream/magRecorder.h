@@ -0,0 +1,115 @@
+#ifndef MAGRECORDER_H
+#define MAGRECORDER_H
+
+/*
+MIT License
+
+Copyright (c) 2021 WagonWheelRobotics
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#include <QString>
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include "magStream.h"
+
+// Record-to-disk of a live stream
+//
+//   parser thread -> record ring -> writer thread -> rolling files
+//
+// The parser copies every sample into a ring of its own (push) and never waits
+// for the disk: when the ring is full the samples are counted in lost(), the
+// display and calibration consumers of the stream are not affected.
+// The writer thread collects the samples per sensor and writes large blocks at
+// MAG_RECORD_ALIGN aligned file offsets. The files are unbuffered, a block goes
+// to the OS in one call. A file is closed after MAG_RECORD_SEGMENT rows and the
+// next one is opened: name-000.csv, name-001.csv, ..., sensor k>0 records to
+// name-sk-000.csv.
+//
+// Formats:
+//   csv      t,x,y,z rows like a log file
+//   magbin   the dataset format of magBin.h. The columns of a whole segment are
+//            reserved when the file is opened and filled in batches, a shorter
+//            last segment is compacted when it is closed. magLoader opens it.
+
+#define MAG_RECORD_CSV          0
+#define MAG_RECORD_MAGBIN       1
+
+#define MAG_RECORD_SAMPLES      (1<<20)     // ring capacity, ~30 s at 32k samples/s
+#define MAG_RECORD_ALIGN        4096        // offset and size of the block writes
+#define MAG_RECORD_BLOCK        (1<<20)     // csv bytes per write
+#define MAG_RECORD_BATCH        65536       // magbin rows per column write
+#define MAG_RECORD_SEGMENT      (1<<22)     // rows per file
+#define MAG_RECORD_IDLE_MS      10          // writer sleep when the ring is empty
+
+class magRecorder
+{
+public:
+    magRecorder(const QString &fileName, int format);      // MAG_RECORD_*
+    ~magRecorder();
+
+    static int formatOf(const QString &fileName);           // by the extension
+
+    void start(void);
+    void stop(void);        // writes the samples left in the ring and closes the files
+
+    // parser thread, never waits
+    void push(const magStreamSample *s, size_t n);
+
+    const QString &fileName() const {return _fileName;}
+    size_t backlog() const {return _ring.size();}
+    uint64_t written() const {return _written;}     // samples
+    uint64_t bytes() const {return _bytes;}
+    uint64_t lost() const {return _lost;}           // ring full or write error
+    bool failed() const {return _failed;}
+
+private:
+    struct segment;
+
+    void run(void);         // writer thread
+    void add(const magStreamSample &s);
+    bool open(segment &f);
+    bool close(segment &f);
+    bool writeText(segment &f, bool all);
+    bool writeBatch(segment &f);
+    bool compact(segment &f);
+    bool write(segment &f, qint64 pos, const char *p, qint64 n);
+    QString segmentName(int sensor, int index) const;
+
+private:
+    QString _fileName;
+    int _format;
+    spscRing<magStreamSample> _ring;
+    std::thread _writer;
+    std::atomic<bool> _running;
+    std::vector<std::unique_ptr<segment> > _segments;     // by sensor, writer thread
+
+    std::atomic<uint64_t> _written;
+    std::atomic<uint64_t> _bytes;
+    std::atomic<uint64_t> _lost;
+    std::atomic<bool> _failed;
+};
+
+#endif // MAGRECORDER_H
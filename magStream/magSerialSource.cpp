@@ -0,0 +1,79 @@
+/*
+MIT License
+
+Copyright (c) 2021 WagonWheelRobotics
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#include "magSerialSource.h"
+
+#include <QSerialPort>
+#include <QTimer>
+#include <QDebug>
+
+magSerialSource::magSerialSource(QSerialPort *port, QObject *parent) : magStreamSource(parent)
+{
+    _port = port;
+    _port->setParent(this);     // moved to the I/O thread together
+    _name = port->portName();
+
+    _retry = new QTimer(this);
+    _retry->setSingleShot(true);
+    _retry->setInterval(MAG_SERIAL_RETRY_MS);
+
+    connect(_port, &QSerialPort::readyRead, this, &magSerialSource::read);
+    connect(_retry, &QTimer::timeout, this, &magSerialSource::read);
+    connect(_port, &QSerialPort::errorOccurred, this, [=](QSerialPort::SerialPortError e)
+    {
+        if(e==QSerialPort::NoError || e==QSerialPort::TimeoutError) return;
+        emit error(QString("%1: %2").arg(_name, _port->errorString()));
+        if(e==QSerialPort::ResourceError) close();     // unplugged
+    });
+}
+
+magSerialSource::~magSerialSource()
+{
+
+}
+
+void magSerialSource::open(void)
+{
+    if(!_port->open(QIODevice::ReadWrite))
+    {
+        emit error(QString("%1: %2").arg(_name, _port->errorString()));
+        return;
+    }
+    _port->setReadBufferSize(0);    // unlimited, holds the data while the ring is full
+    emit opened(_name);
+}
+
+void magSerialSource::close(void)
+{
+    _retry->stop();
+    if(!_port->isOpen()) return;
+    read();
+    _port->close();
+    emit closed();
+}
+
+void magSerialSource::read(void)
+{
+    if(!drain(_port) && !_retry->isActive()) _retry->start();
+}
@@ -0,0 +1,63 @@
+#ifndef MAGSERIALSOURCE_H
+#define MAGSERIALSOURCE_H
+
+/*
+MIT License
+
+Copyright (c) 2021 WagonWheelRobotics
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#include <QString>
+
+#include "magStream.h"
+
+class QSerialPort;
+class QTimer;
+
+// serial port end of a magStream
+// The port is configured by serialPortDialog, it is opened and read in the I/O thread.
+// While the byte ring is full the data stays in the port buffer and drain() is retried.
+
+#define MAG_SERIAL_RETRY_MS     2
+
+class magSerialSource : public magStreamSource
+{
+    Q_OBJECT
+public:
+    explicit magSerialSource(QSerialPort *port, QObject *parent=nullptr);      // takes the port
+    virtual ~magSerialSource();
+
+    virtual QString name() const {return _name;}
+
+public slots:
+    virtual void open(void);
+    virtual void close(void);
+
+private:
+    void read(void);
+
+private:
+    QSerialPort *_port;
+    QTimer *_retry;
+    QString _name;
+};
+
+#endif // MAGSERIALSOURCE_H
@@ -0,0 +1,393 @@
+/*
+MIT License
+
+Copyright (c) 2021 WagonWheelRobotics
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#include "magStream.h"
+
+#include <QIODevice>
+#include <QThread>
+#include <QDebug>
+
+#include <chrono>
+#include <cmath>
+#include <cstring>
+
+#include "magLogParser.h"
+#include "magRecorder.h"
+
+static double now(void)
+{
+    return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+magStreamSource::magStreamSource(QObject *parent) : QObject(parent)
+{
+    _ring = nullptr;
+    _bytes = 0;
+    _overruns = 0;
+    _reconnects = 0;
+    _boundary = 0;
+}
+
+magStreamSource::~magStreamSource()
+{
+
+}
+
+bool magStreamSource::drain(QIODevice *device)
+{
+    for(;;)
+    {
+        const qint64 available=device->bytesAvailable();
+        if(available<=0) return true;
+
+        size_t n;
+        char *p=_ring->writeRegion(n);
+        if(n==0)
+        {
+            _overruns++;
+            return false;
+        }
+        const qint64 r=device->read(p, std::min<qint64>((qint64)n, available));
+        if(r<=0) return true;
+        _ring->commitWrite((size_t)r);
+        _bytes += (uint64_t)r;
+    }
+}
+
+void magStreamSource::markBoundary(void)
+{
+    if(_bytes>0) _reconnects++;
+    _boundary = _ring->written();
+}
+
+magStream::magStream(magStreamSource *source, QObject *parent) : QObject(parent),
+    _bytes(MAG_STREAM_BYTES), _samples(MAG_STREAM_SAMPLES)
+{
+    _source = source;
+    _source->setParent(nullptr);
+    _source->setRing(&_bytes);
+    _recorder = nullptr;
+    _io = nullptr;
+    _running = false;
+    _framing = MAG_STREAM_FRAMING_NEWLINE;
+    _lineLength = 0;
+    _lineOverflow = false;
+    _frameSize = -1;
+    _headerLength = 0;
+    _boundary = 0;
+    _delimiter = 0;
+    _columns = 0;
+    _t0 = 0.0;
+    _parsed = 0;
+    _rejected = 0;
+    _dropped = 0;
+    _wireErrors = 0;
+    _gaps = 0;
+
+    connect(_source, &magStreamSource::opened, this, &magStream::opened);
+    connect(_source, &magStreamSource::error, this, &magStream::error);
+}
+
+magStream::~magStream()
+{
+    stop();
+    delete _recorder;
+    delete _source;
+}
+
+void magStream::setRecorder(magRecorder *recorder)
+{
+    if(_io!=nullptr) return;
+    delete _recorder;
+    _recorder = recorder;
+}
+
+void magStream::start(void)
+{
+    if(_running || _io!=nullptr) return;
+
+    _t0 = now();
+    _running = true;
+
+    if(_recorder!=nullptr) _recorder->start();
+    _parser = std::thread([this](){parse();});
+
+    _io = new QThread;
+    _source->moveToThread(_io);
+    _io->start(QThread::HighPriority);
+    QMetaObject::invokeMethod(_source, "open");
+}
+
+void magStream::stop(void)
+{
+    if(_io==nullptr) return;
+
+    QMetaObject::invokeMethod(_source, "close", Qt::BlockingQueuedConnection);
+    _io->quit();
+    _io->wait();
+    delete _io;
+    _io = nullptr;
+
+    // the parser finishes the bytes which are already received
+    _running = false;
+    if(_parser.joinable()) _parser.join();
+    if(_recorder!=nullptr) _recorder->stop();
+}
+
+magStreamStats magStream::stats() const
+{
+    magStreamStats s;
+    s.bytes = _source->bytes();
+    s.samples = _parsed;
+    s.rejected = _rejected + _wireErrors;
+    s.overruns = _source->overruns();
+    s.dropped = _dropped;
+    s.reconnects = _source->reconnects();
+    s.gaps = _gaps;
+    return s;
+}
+
+QStringList magStream::framingNames()
+{
+    return QStringList{"Newline (text rows)", "Length prefixed (uint16 LE)", "Binary frames (COBS)"};
+}
+
+void magStream::resetFrame(void)
+{
+    if(_lineLength || _frameSize>=0 || _headerLength || _wire.partial()) _dropped++;
+    _wire.reset();
+    _lineLength = 0;
+    _lineOverflow = false;
+    _frameSize = -1;
+    _headerLength = 0;
+}
+
+void magStream::parse(void)
+{
+    for(;;)
+    {
+        size_t n;
+        const char *p=_bytes.readRegion(n);
+
+        // bytes of a new connection do not complete a frame of the old one,
+        // and its sequence numbers do not continue the old ones
+        const size_t boundary=_source->boundary();
+        if(boundary!=_boundary)
+        {
+            const size_t tail=_bytes.consumed();
+            if(tail>=boundary)
+            {
+                resetFrame();
+                _boundary = boundary;
+            }
+            else
+            {
+                n = std::min(n, boundary-tail);
+            }
+        }
+
+        size_t used=0;
+        if(n)
+        {
+            switch(_framing)
+            {
+            case MAG_STREAM_FRAMING_LENGTH: used = parseFramed(p, n); break;
+            case MAG_STREAM_FRAMING_COBS:   used = parseWire(p, n); break;
+            default:                        used = parseText(p, n); break;
+            }
+        }
+        _bytes.commitRead(used);
+        if(used==0)
+        {
+            if(!_running) break;
+            std::this_thread::sleep_for(std::chrono::microseconds(MAG_STREAM_IDLE_US));
+        }
+    }
+}
+
+// returns the consumed bytes, a line which is split by the ring end or by the
+// reads of the source is collected in _line
+size_t magStream::parseText(const char *p, size_t n)
+{
+    const char *end=p+n;
+    const char *q=p;
+    while(q<end)
+    {
+        if(_samples.free()<MAG_STREAM_MAX_SENSORS) break;      // consumer is behind, try again later
+
+        const char *eol=(const char*)std::memchr(q, '\n', end-q);
+        if(eol!=nullptr && _lineLength==0)
+        {
+            parseLine(q, eol);
+            q = eol+1;
+            continue;
+        }
+
+        const char *e = eol!=nullptr ? eol : end;
+        const size_t len=e-q;
+        if(_lineLength+len<=MAG_STREAM_LINE)
+        {
+            std::memcpy(_line+_lineLength, q, len);
+            _lineLength += len;
+        }
+        else
+        {
+            _lineOverflow = true;
+        }
+        if(eol==nullptr) return n;
+
+        if(_lineOverflow) _dropped++;
+        else parseLine(_line, _line+_lineLength);
+        _lineLength = 0;
+        _lineOverflow = false;
+        q = eol+1;
+    }
+    return q-p;
+}
+
+// a payload which is contiguous in the ring is parsed in place, otherwise it is collected in _line
+size_t magStream::parseFramed(const char *p, size_t n)
+{
+    const char *end=p+n;
+    const char *q=p;
+    while(q<end)
+    {
+        if(_samples.free()<MAG_STREAM_MAX_SENSORS) break;
+
+        if(_frameSize<0)
+        {
+            _header[_headerLength++] = (uint8_t)*q++;
+            if(_headerLength==2)
+            {
+                _frameSize = _header[0] | (_header[1]<<8);
+                _headerLength = 0;
+            }
+            continue;
+        }
+
+        const size_t len=std::min<size_t>(end-q, (size_t)_frameSize-_lineLength);
+        if(_lineLength==0 && len==(size_t)_frameSize)
+        {
+            parseLine(q, q+len);
+            _frameSize = -1;
+        }
+        else
+        {
+            if(_frameSize<=MAG_STREAM_LINE) std::memcpy(_line+_lineLength, q, len);
+            _lineLength += len;
+            if(_lineLength==(size_t)_frameSize)
+            {
+                if(_frameSize<=MAG_STREAM_LINE) parseLine(_line, _line+_lineLength);
+                else _dropped++;
+                _lineLength = 0;
+                _frameSize = -1;
+            }
+        }
+        q += len;
+    }
+    return q-p;
+}
+
+size_t magStream::parseWire(const char *p, size_t n)
+{
+    const uint8_t *b=(const uint8_t*)p;
+    size_t q=0;
+    while(q<n)
+    {
+        if(_samples.free()<MAG_WIRE_MAX_SAMPLES) break;
+
+        bool ready;
+        q += _wire.feed(b+q, n-q, _frame, &ready);
+        if(!ready) continue;
+
+        magStreamSample s[MAG_WIRE_MAX_SAMPLES];
+        for(int i=0;i<_frame.count;i++)
+        {
+            const double t=(_frame.t0 + (uint64_t)i*_frame.dt)*1e-6;
+            s[i] = magStreamSample{t, (double)_frame.xyz[3*i], (double)_frame.xyz[3*i+1], (double)_frame.xyz[3*i+2], _frame.sensor};
+        }
+        _samples.push(s, _frame.count);
+        if(_recorder!=nullptr) _recorder->push(s, _frame.count);
+        _parsed += _frame.count;
+    }
+    _wireErrors = _wire.crcErrors() + _wire.malformed();
+    _gaps = _wire.gaps();
+    return q;
+}
+
+// the first row decides the delimiter and the column count, like magLogParser
+void magStream::parseLine(const char *p, const char *eol)
+{
+    double v[MAG_STREAM_MAX_COLUMNS];
+    int n=-1;
+    if(_delimiter==0)
+    {
+        const char candidates[]={',', '\t', ';', ' '};
+        for(auto d:candidates)
+        {
+            n = magLogParser::parseLine(p, eol, d, v, MAG_STREAM_MAX_COLUMNS);
+            if(n>=3 && n<=MAG_STREAM_MAX_COLUMNS)
+            {
+                _delimiter = d;
+                _columns = n;
+                break;
+            }
+        }
+    }
+    else
+    {
+        n = magLogParser::parseLine(p, eol, _delimiter, v, MAG_STREAM_MAX_COLUMNS);
+    }
+
+    if(n!=_columns)
+    {
+        while(p<eol && (*p==' ' || *p=='\t' || *p=='\r')) p++;
+        if(p<eol) _rejected++;      // blank lines are not counted
+        return;
+    }
+    if(n>3 && !std::isfinite(v[0]))
+    {
+        _rejected++;                // the recording is sorted by time when the stream stops
+        return;
+    }
+
+    magStreamSample s[MAG_STREAM_MAX_SENSORS];
+    int nSensors=1;
+    if(n==3)
+    {
+        s[0] = magStreamSample{now()-_t0, v[0], v[1], v[2], 0};
+    }
+    else if(n>=7 && (n-1)%3==0)
+    {
+        nSensors = (n-1)/3;
+        for(int i=0;i<nSensors;i++) s[i] = magStreamSample{v[0], v[1+3*i], v[2+3*i], v[3+3*i], i};
+    }
+    else
+    {
+        s[0] = magStreamSample{v[0], v[1], v[2], v[3], 0};
+    }
+    _samples.push(s, nSensors);
+    if(_recorder!=nullptr) _recorder->push(s, nSensors);
+    _parsed += nSensors;
+}
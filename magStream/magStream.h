@@ -0,0 +1,201 @@
+#ifndef MAGSTREAM_H
+#define MAGSTREAM_H
+
+/*
+MIT License
+
+Copyright (c) 2021 WagonWheelRobotics
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#include <QObject>
+#include <QString>
+#include <QStringList>
+
+#include <atomic>
+#include <cstdint>
+#include <thread>
+
+#include "magWire.h"
+#include "spscRing.h"
+
+class QIODevice;
+class QThread;
+class magRecorder;
+
+// Live sample stream
+//
+//   source (I/O thread) -> byte ring -> parser thread -> sample ring -> consumer (GUI frame timer)
+//
+// The source drains its device into the byte ring. When the ring is full the
+// bytes stay in the device buffer (overruns() counts these stalls), nothing is
+// dropped. The parser thread splits the bytes into text lines, the same rows as
+// a log file (x,y,z or t,x,y,z or t,x0,y0,z0,x1,y1,z1,...), and pushes one
+// sample per sensor. It stops reading while the sample ring is full, so a slow
+// consumer throttles the stream instead of losing samples.
+// Rows without a time stamp are stamped with the arrival time.
+//
+// Framing (setFraming):
+//   newline   text rows ending with '\n'
+//   length    uint16 little endian payload length, then one text row without '\n'
+//   cobs      binary frames of magWire, blocks of samples with sequence numbers
+// A source which reconnects marks the position in the byte stream (markBoundary),
+// the parser discards a frame which is cut there and counts it in dropped.
+// A magRecorder gets a copy of every sample in a ring of its own and writes
+// them to disk, it never holds back the parser.
+
+#define MAG_STREAM_BYTES        (4<<20)     // byte ring capacity
+#define MAG_STREAM_SAMPLES      (1<<18)     // sample ring capacity
+#define MAG_STREAM_LINE         1024        // max text line length
+#define MAG_STREAM_MAX_SENSORS  16
+#define MAG_STREAM_MAX_COLUMNS  (1+3*MAG_STREAM_MAX_SENSORS)
+#define MAG_STREAM_IDLE_US      500         // parser sleep when there is nothing to do
+
+#define MAG_STREAM_FRAMING_NEWLINE  0
+#define MAG_STREAM_FRAMING_LENGTH   1
+#define MAG_STREAM_FRAMING_COBS     2
+
+struct magStreamSample
+{
+    double t;
+    double x;
+    double y;
+    double z;
+    int sensor;
+};
+
+// running totals since start()
+struct magStreamStats
+{
+    uint64_t bytes;         // received
+    uint64_t samples;       // parsed
+    uint64_t rejected;      // lines which are not a row or have no finite time, binary frames with a bad CRC
+    uint64_t overruns;      // byte ring full, the source waited
+    uint64_t dropped;       // frames cut by a reconnect or too long
+    uint64_t reconnects;
+    uint64_t gaps;          // binary frames lost on the link (sequence numbers)
+};
+
+// I/O end of a stream, moved to the I/O thread by magStream
+// open() and close() run in the I/O thread, read the device with drain()
+class magStreamSource : public QObject
+{
+    Q_OBJECT
+public:
+    explicit magStreamSource(QObject *parent=nullptr);
+    virtual ~magStreamSource();
+
+    virtual QString name() const=0;
+
+    void setRing(spscRing<char> *ring) {_ring=ring;}
+    uint64_t bytes() const {return _bytes;}
+    uint64_t overruns() const {return _overruns;}
+    uint64_t reconnects() const {return _reconnects;}
+    size_t boundary() const {return _boundary;}     // ring position of the last reconnect
+
+public slots:
+    virtual void open(void)=0;
+    virtual void close(void)=0;
+
+signals:
+    void opened(QString name);
+    void error(QString message);
+    void closed(void);
+
+protected:
+    // moves the available bytes of the device into the ring, returns false if the ring became full
+    bool drain(QIODevice *device);
+    void markBoundary(void);    // a new connection starts at the current write position
+
+private:
+    spscRing<char> *_ring;
+    std::atomic<uint64_t> _bytes;
+    std::atomic<uint64_t> _overruns;
+    std::atomic<uint64_t> _reconnects;
+    std::atomic<size_t> _boundary;
+};
+
+class magStream : public QObject
+{
+    Q_OBJECT
+public:
+    explicit magStream(magStreamSource *source, QObject *parent=nullptr);     // takes the source
+    virtual ~magStream();
+
+    void start(void);   // once, a stopped stream is not restarted
+    void stop(void);    // waits for the threads
+    bool isRunning() const {return _running;}
+
+    QString name() const {return _source->name();}
+    void setFraming(int framing) {_framing=framing;}    // MAG_STREAM_FRAMING_*, before start()
+    void setRecorder(magRecorder *recorder);            // takes the recorder, before start()
+    const magRecorder *recorder() const {return _recorder;}
+    static QStringList framingNames();
+    magStreamStats stats() const;
+    size_t backlog() const {return _samples.size();}
+
+    // consumer side of the sample ring, call from one thread only
+    size_t take(magStreamSample *samples, size_t max) {return _samples.pop(samples, max);}
+
+signals:
+    void opened(QString name);
+    void error(QString message);
+
+private:
+    void parse(void);       // parser thread
+    size_t parseText(const char *p, size_t n);
+    size_t parseFramed(const char *p, size_t n);
+    size_t parseWire(const char *p, size_t n);
+    void parseLine(const char *p, const char *eol);
+    void resetFrame(void);
+
+private:
+    magStreamSource *_source;
+    magRecorder *_recorder;
+    QThread *_io;
+    std::thread _parser;
+    std::atomic<bool> _running;
+
+    spscRing<char> _bytes;
+    spscRing<magStreamSample> _samples;
+    int _framing;
+
+    // parser thread state
+    char _line[MAG_STREAM_LINE];
+    size_t _lineLength;
+    bool _lineOverflow;
+    int _frameSize;         // length framing: payload size, -1 while reading the header
+    uint8_t _header[2];
+    int _headerLength;
+    size_t _boundary;       // last boundary of the source which is handled
+    magWireDecoder _wire;
+    magWireFrame _frame;
+    char _delimiter;
+    int _columns;
+    double _t0;             // arrival time base
+
+    std::atomic<uint64_t> _parsed;
+    std::atomic<uint64_t> _rejected;
+    std::atomic<uint64_t> _dropped;
+    std::atomic<uint64_t> _wireErrors;
+    std::atomic<uint64_t> _gaps;
+};
+
+#endif // MAGSTREAM_H
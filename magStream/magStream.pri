@@ -0,0 +1,16 @@
+HEADERS += \
+    $$PWD/magSerialSource.h \
+    $$PWD/magRecorder.h \
+    $$PWD/magStream.h \
+    $$PWD/magTcpSource.h \
+    $$PWD/magWire.h \
+    $$PWD/spscRing.h
+
+SOURCES += \
+    $$PWD/magRecorder.cpp \
+    $$PWD/magSerialSource.cpp \
+    $$PWD/magStream.cpp \
+    $$PWD/magTcpSource.cpp \
+    $$PWD/magWire.cpp
+
+INCLUDEPATH += $$PWD
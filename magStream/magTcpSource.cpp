@@ -0,0 +1,116 @@
+/*
+MIT License
+
+Copyright (c) 2021 WagonWheelRobotics
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#include "magTcpSource.h"
+
+#include <QTcpSocket>
+#include <QTimer>
+#include <QDebug>
+
+#include <algorithm>
+
+magTcpSource::magTcpSource(const QString &host, quint16 port, QObject *parent) : magStreamSource(parent)
+{
+    _host = host;
+    _port = port;
+    _delay = MAG_TCP_RECONNECT_MS;
+    _closing = false;
+
+    _socket = new QTcpSocket(this);
+    _socket->setReadBufferSize(MAG_TCP_READ_BUFFER);
+
+    _retry = new QTimer(this);
+    _retry->setSingleShot(true);
+    _retry->setInterval(MAG_TCP_RETRY_MS);
+
+    _reconnect = new QTimer(this);
+    _reconnect->setSingleShot(true);
+
+    connect(_socket, &QTcpSocket::readyRead, this, &magTcpSource::read);
+    connect(_retry, &QTimer::timeout, this, &magTcpSource::read);
+    connect(_reconnect, &QTimer::timeout, this, &magTcpSource::connectToHost);
+    connect(_socket, &QTcpSocket::connected, this, [=]()
+    {
+        _delay = MAG_TCP_RECONNECT_MS;
+        emit opened(name());
+    });
+    connect(_socket, &QTcpSocket::disconnected, this, &magTcpSource::lost);
+#if QT_VERSION >= QT_VERSION_CHECK(5, 15, 0)
+    const auto socketError=&QAbstractSocket::errorOccurred;
+#else
+    const auto socketError=QOverload<QAbstractSocket::SocketError>::of(&QAbstractSocket::error);     // Qt 5.12 of the release build
+#endif
+    connect(_socket, socketError, this, [=](QAbstractSocket::SocketError)
+    {
+        if(_closing) return;
+        emit error(QString("%1: %2").arg(name(), _socket->errorString()));
+        if(_socket->state()!=QAbstractSocket::ConnectedState) lost();
+    });
+}
+
+magTcpSource::~magTcpSource()
+{
+
+}
+
+void magTcpSource::open(void)
+{
+    _closing = false;
+    connectToHost();
+}
+
+void magTcpSource::close(void)
+{
+    _closing = true;
+    _reconnect->stop();
+    _retry->stop();
+    if(_socket->state()==QAbstractSocket::ConnectedState) read();
+    _socket->abort();
+    emit closed();
+}
+
+// every connection starts at a frame boundary
+void magTcpSource::connectToHost(void)
+{
+    if(_closing) return;
+    markBoundary();
+    _socket->connectToHost(_host, _port, QIODevice::ReadOnly);
+}
+
+void magTcpSource::read(void)
+{
+    if(!drain(_socket) && !_retry->isActive()) _retry->start();
+}
+
+void magTcpSource::lost(void)
+{
+    if(_closing || _reconnect->isActive()) return;
+    _retry->stop();
+    read();     // what is left in the socket buffer belongs to the old connection
+    _socket->abort();
+
+    qWarning()<<name()<<"reconnecting in"<<_delay<<"ms";
+    _reconnect->start(_delay);
+    _delay = std::min(2*_delay, MAG_TCP_RECONNECT_MAX_MS);
+}
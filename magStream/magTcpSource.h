@@ -0,0 +1,74 @@
+#ifndef MAGTCPSOURCE_H
+#define MAGTCPSOURCE_H
+
+/*
+MIT License
+
+Copyright (c) 2021 WagonWheelRobotics
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#include <QString>
+
+#include "magStream.h"
+
+class QTcpSocket;
+class QTimer;
+
+// TCP client end of a magStream (tcpClientDialog)
+// The socket lives in the I/O thread and reads straight into the byte ring,
+// the ring storage is the buffer pool, nothing is allocated per packet.
+// The socket buffer is bounded, so a full ring applies TCP flow control to the sender.
+// A lost connection is retried with an increasing delay until close().
+
+#define MAG_TCP_READ_BUFFER     (1<<20)     // socket buffer while the ring is full
+#define MAG_TCP_RETRY_MS        2           // drain retry while the ring is full
+#define MAG_TCP_RECONNECT_MS    500         // first reconnect delay, doubled up to the max
+#define MAG_TCP_RECONNECT_MAX_MS 5000
+
+class magTcpSource : public magStreamSource
+{
+    Q_OBJECT
+public:
+    magTcpSource(const QString &host, quint16 port, QObject *parent=nullptr);
+    virtual ~magTcpSource();
+
+    virtual QString name() const {return QString("%1:%2").arg(_host).arg(_port);}
+
+public slots:
+    virtual void open(void);
+    virtual void close(void);
+
+private:
+    void connectToHost(void);
+    void read(void);
+    void lost(void);
+
+private:
+    QString _host;
+    quint16 _port;
+    QTcpSocket *_socket;
+    QTimer *_retry;
+    QTimer *_reconnect;
+    int _delay;
+    bool _closing;
+};
+
+#endif // MAGTCPSOURCE_H
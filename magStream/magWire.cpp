@@ -0,0 +1,249 @@
+/*
+MIT License
+
+Copyright (c) 2021 WagonWheelRobotics
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#include "magWire.h"
+
+#include <cstring>
+
+static inline void put16(uint8_t *p, uint16_t v)
+{
+    p[0] = (uint8_t)v;
+    p[1] = (uint8_t)(v>>8);
+}
+
+static inline void put32(uint8_t *p, uint32_t v)
+{
+    for(int i=0;i<4;i++) p[i] = (uint8_t)(v>>(8*i));
+}
+
+static inline void put64(uint8_t *p, uint64_t v)
+{
+    for(int i=0;i<8;i++) p[i] = (uint8_t)(v>>(8*i));
+}
+
+static inline uint16_t get16(const uint8_t *p)
+{
+    return (uint16_t)(p[0] | (p[1]<<8));
+}
+
+static inline uint32_t get32(const uint8_t *p)
+{
+    return (uint32_t)p[0] | ((uint32_t)p[1]<<8) | ((uint32_t)p[2]<<16) | ((uint32_t)p[3]<<24);
+}
+
+static inline uint64_t get64(const uint8_t *p)
+{
+    return (uint64_t)get32(p) | ((uint64_t)get32(p+4)<<32);
+}
+
+struct crcTable
+{
+    uint16_t t[256];
+    crcTable()
+    {
+        for(int i=0;i<256;i++)
+        {
+            uint16_t c=(uint16_t)(i<<8);
+            for(int b=0;b<8;b++) c = (c&0x8000) ? (uint16_t)((c<<1)^0x1021) : (uint16_t)(c<<1);
+            t[i] = c;
+        }
+    }
+};
+
+// poly 0x1021, init 0xffff, no reflection
+uint16_t magWireCrc(const uint8_t *p, size_t n)
+{
+    static const crcTable table;
+    uint16_t crc=0xffff;
+    for(size_t i=0;i<n;i++) crc = (uint16_t)((crc<<8) ^ table.t[((crc>>8) ^ p[i]) & 0xff]);
+    return crc;
+}
+
+size_t magWireEncode(const magWireFrame &frame, uint8_t *out)
+{
+    uint8_t raw[MAG_WIRE_MAX_FRAME];
+    const int count=frame.count<1 ? 1 : (frame.count>MAG_WIRE_MAX_SAMPLES ? MAG_WIRE_MAX_SAMPLES : frame.count);
+    raw[0] = frame.wide ? MAG_WIRE_FLAG_INT32 : 0;
+    raw[1] = (uint8_t)frame.sensor;
+    put16(raw+2, frame.sequence);
+    put64(raw+4, frame.t0);
+    put32(raw+12, frame.dt);
+    raw[16] = (uint8_t)count;
+    size_t n=MAG_WIRE_HEADER;
+    for(int i=0;i<3*count;i++)
+    {
+        if(frame.wide)
+        {
+            put32(raw+n, (uint32_t)frame.xyz[i]);
+            n += 4;
+        }
+        else
+        {
+            put16(raw+n, (uint16_t)(int16_t)frame.xyz[i]);
+            n += 2;
+        }
+    }
+    put16(raw+n, magWireCrc(raw, n));
+    n += 2;
+
+    // COBS: every zero is replaced by the distance to the next one
+    size_t o=0, code=o++;
+    uint8_t c=1;
+    for(size_t i=0;i<n;i++)
+    {
+        if(raw[i]==0)
+        {
+            out[code] = c;
+            code = o++;
+            c = 1;
+        }
+        else
+        {
+            out[o++] = raw[i];
+            if(++c==0xff)
+            {
+                out[code] = c;
+                code = o++;
+                c = 1;
+            }
+        }
+    }
+    out[code] = c;
+    out[o++] = 0;
+    return o;
+}
+
+magWireDecoder::magWireDecoder()
+{
+    _frames = 0;
+    _crcErrors = 0;
+    _malformed = 0;
+    _gaps = 0;
+    reset();
+}
+
+void magWireDecoder::reset(void)
+{
+    std::memset(_seen, 0, sizeof(_seen));
+    std::memset(_next, 0, sizeof(_next));
+    clearFrame();
+}
+
+void magWireDecoder::clearFrame(void)
+{
+    _length = 0;
+    _code = 0xff;
+    _remaining = 0;
+    _overflow = false;
+}
+
+size_t magWireDecoder::feed(const uint8_t *p, size_t n, magWireFrame &frame, bool *ready)
+{
+    *ready = false;
+    for(size_t i=0;i<n;i++)
+    {
+        const uint8_t b=p[i];
+        if(b==0)
+        {
+            // delimiter, a frame ends exactly at the end of a block
+            if(_length>0 || _remaining>0)
+            {
+                if(_overflow || _remaining>0) _malformed++;
+                else *ready = decode(frame);
+            }
+            clearFrame();
+            return i+1;
+        }
+
+        if(_remaining==0)
+        {
+            // code byte, the previous block (unless it was full) ended with a zero
+            if(_code!=0xff)
+            {
+                if(_length<MAG_WIRE_MAX_FRAME) _buf[_length++] = 0;
+                else _overflow = true;
+            }
+            _code = b;
+            _remaining = b-1;
+        }
+        else
+        {
+            if(_length<MAG_WIRE_MAX_FRAME) _buf[_length++] = b;
+            else _overflow = true;
+            _remaining--;
+        }
+    }
+    return n;
+}
+
+bool magWireDecoder::decode(magWireFrame &frame)
+{
+    if(_length<MAG_WIRE_HEADER+2 || magWireCrc(_buf, _length-2)!=get16(_buf+_length-2))
+    {
+        _crcErrors++;
+        return false;
+    }
+
+    const uint8_t flags=_buf[0];
+    const int count=_buf[16];
+    const int wide=(flags & MAG_WIRE_FLAG_INT32) ? 1 : 0;
+    if((flags>>4)!=0 || count<1 || count>MAG_WIRE_MAX_SAMPLES || _length!=(size_t)(MAG_WIRE_HEADER + count*(wide ? 12 : 6) + 2))
+    {
+        _malformed++;
+        return false;
+    }
+
+    frame.sensor = _buf[1];
+    frame.sequence = get16(_buf+2);
+    frame.t0 = get64(_buf+4);
+    frame.dt = get32(_buf+12);
+    frame.count = count;
+    frame.wide = wide;
+    const uint8_t *v=_buf+MAG_WIRE_HEADER;
+    for(int i=0;i<3*count;i++)
+    {
+        if(wide)
+        {
+            frame.xyz[i] = (int32_t)get32(v);
+            v += 4;
+        }
+        else
+        {
+            frame.xyz[i] = (int16_t)get16(v);
+            v += 2;
+        }
+    }
+
+    // lost frames, a jump back by more than half the range is a restart of the sender
+    const int s=frame.sensor;
+    if(_seen[s])
+    {
+        const uint16_t skipped=(uint16_t)(frame.sequence-_next[s]);
+        if(skipped<0x8000) _gaps += skipped;
+    }
+    _seen[s] = true;
+    _next[s] = (uint16_t)(frame.sequence+1);
+    _frames++;
+    return true;
+}
@@ -0,0 +1,138 @@
+#ifndef SPSCRING_H
+#define SPSCRING_H
+
+/*
+MIT License
+
+Copyright (c) 2021 WagonWheelRobotics
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <vector>
+
+// Lock-free single producer, single consumer ring buffer
+//
+// The capacity is rounded up to a power of two. head is written by the producer
+// only and tail by the consumer only, each on its own cache line, so neither
+// side ever waits for the other. The regions give direct access to the storage,
+// a reader can write into the ring (QIODevice::read) without a bounce buffer:
+//
+//   size_t n;
+//   T *p=ring.writeRegion(n);      // contiguous free space, n may be 0
+//   ... fill m<=n items ...
+//   ring.commitWrite(m);
+//
+// clear() and the constructor must not run concurrently with the producer or the consumer.
+
+template <typename T>
+class spscRing
+{
+public:
+    explicit spscRing(size_t capacity)
+    {
+        size_t c=1;
+        while(c<capacity) c<<=1;
+        _buf.resize(c);
+        _mask = c-1;
+        _head = 0;
+        _tail = 0;
+    }
+
+    size_t capacity() const {return _buf.size();}
+    // any thread: the tail is read first so it is never ahead of the head, the clamp covers
+    // the producer refilling space the consumer freed after the tail was read
+    size_t size() const
+    {
+        const size_t tail=_tail.load(std::memory_order_acquire);
+        const size_t head=_head.load(std::memory_order_acquire);
+        return std::min(head-tail, capacity());
+    }
+    size_t free() const {return capacity() - size();}
+    bool empty() const {return size()==0;}
+    size_t written() const {return _head.load(std::memory_order_acquire);}     // total, never wraps in practice
+    size_t consumed() const {return _tail.load(std::memory_order_acquire);}
+
+    void clear() {_head=0; _tail=0;}
+
+    // producer
+    T *writeRegion(size_t &n)
+    {
+        const size_t head=_head.load(std::memory_order_relaxed);
+        const size_t tail=_tail.load(std::memory_order_acquire);
+        const size_t pos=head & _mask;
+        n = std::min(capacity() - (head-tail), capacity() - pos);
+        return _buf.data() + pos;
+    }
+
+    void commitWrite(size_t n)
+    {
+        _head.store(_head.load(std::memory_order_relaxed) + n, std::memory_order_release);
+    }
+
+    // all or nothing, false if there is not enough space
+    bool push(const T *v, size_t n)
+    {
+        const size_t head=_head.load(std::memory_order_relaxed);
+        if(capacity() - (head - _tail.load(std::memory_order_acquire)) < n) return false;
+        for(size_t i=0;i<n;i++) _buf[(head+i) & _mask] = v[i];
+        _head.store(head+n, std::memory_order_release);
+        return true;
+    }
+
+    bool push(const T &v) {return push(&v, 1);}
+
+    // consumer
+    const T *readRegion(size_t &n) const
+    {
+        const size_t tail=_tail.load(std::memory_order_relaxed);
+        const size_t head=_head.load(std::memory_order_acquire);
+        const size_t pos=tail & _mask;
+        n = std::min(head-tail, capacity() - pos);
+        return _buf.data() + pos;
+    }
+
+    void commitRead(size_t n)
+    {
+        _tail.store(_tail.load(std::memory_order_relaxed) + n, std::memory_order_release);
+    }
+
+    // up to n items, returns the count
+    size_t pop(T *v, size_t n)
+    {
+        const size_t tail=_tail.load(std::memory_order_relaxed);
+        const size_t head=_head.load(std::memory_order_acquire);
+        n = std::min(n, head-tail);
+        for(size_t i=0;i<n;i++) v[i] = _buf[(tail+i) & _mask];
+        _tail.store(tail+n, std::memory_order_release);
+        return n;
+    }
+
+private:
+    std::vector<T> _buf;
+    size_t _mask;
+    alignas(64) std::atomic<size_t> _head;     // next write, producer
+    alignas(64) std::atomic<size_t> _tail;     // next read, consumer
+    char _pad[64-sizeof(std::atomic<size_t>)];
+};
+
+#endif // SPSCRING_H
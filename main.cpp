@@ -26,13 +26,27 @@ SOFTWARE.
 
 
 #include <QApplication>
+#include <QCoreApplication>
 
 #include "logging.h"
+#include "magBatch.h"
+#include "magReplay.h"
 
 
 
 int main(int argc, char *argv[])
 {
+    if(magBatchRequested(argc, argv))
+    {
+        QCoreApplication a(argc, argv);     // no display is needed
+        return magBatch(a.arguments());
+    }
+    if(magReplayRequested(argc, argv))
+    {
+        QCoreApplication a(argc, argv);
+        return magReplay(a.arguments());
+    }
+
     QApplication a(argc, argv);
 
     MainWindow w;
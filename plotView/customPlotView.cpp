@@ -39,6 +39,11 @@ void customPlotView::addData(const QVector<double> &data)
     // for realtime plot
 }
 
+void customPlotView::addColumns(const QVector<QVector<double> > &columns)
+{
+    // for realtime plot
+}
+
 void customPlotView::setWidget(QWidget *newWidget)
 {
     _widget = newWidget;
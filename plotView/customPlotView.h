@@ -38,6 +38,7 @@ public:
     QWidget *widget() const;
 
     virtual void addData(const QVector<double> &data);
+    virtual void addColumns(const QVector<QVector<double> > &columns);    // x, y1, y2, ... many rows at once
 
 protected:
     void setWidget(QWidget *newWidget);
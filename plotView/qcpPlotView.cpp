@@ -90,6 +90,15 @@ qcpPlotView::qcpPlotView(QVariantMap m, QWidget *parent): QCustomPlot(parent), c
         yAxis->setRangeUpper(m["y_max"].toDouble());
     }
 
+    if(m["y_log"].toBool())
+    {
+        yAxis->setScaleType(QCPAxis::stLogarithmic);
+        yAxis->setTicker(QSharedPointer<QCPAxisTickerLog>(new QCPAxisTickerLog));
+    }
+
+    _autoScale = m["autoscale"].toBool();
+    _history = m["history"].toDouble();
+
     int x_item=0;
     if(m.contains("x_item"))
     {
@@ -238,13 +247,40 @@ void qcpPlotView::addData(const QVector<double> &data)
         }
     }
 
-    if(_realtimeMode == REALTIME_AUTOSCROLL)
+    if(_autoScale)
+    {
+        rescaleAxes();
+    }
+    else if(_realtimeMode == REALTIME_AUTOSCROLL)
     {
         xAxis->setRange(x, xAxis->range().size(), Qt::AlignRight);
     }
     replot();
 }
 
+// one replot for the whole batch, live streams add a frame of samples at a time
+void qcpPlotView::addColumns(const QVector<QVector<double> > &columns)
+{
+    if(_realtimeMode==STATIC || columns.isEmpty() || columns.front().isEmpty()) return;
+
+    const QVector<double> &x = columns.front();
+    for(int i=1;i<columns.size() && i-1<graphCount();i++)
+    {
+        graph(i-1)->addData(x, columns[i], true);
+        if(_history>0.0) graph(i-1)->data()->removeBefore(x.back()-_history);
+    }
+
+    if(_autoScale)
+    {
+        rescaleAxes();
+    }
+    else if(_realtimeMode == REALTIME_AUTOSCROLL)
+    {
+        xAxis->setRange(x.back(), xAxis->range().size(), Qt::AlignRight);
+    }
+    replot();
+}
+
 void qcpPlotView::uiTaskRequest(QVariantMap params)
 {
     auto obj= params["this"].value<QObject*>();
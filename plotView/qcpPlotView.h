@@ -36,12 +36,15 @@ public:
     qcpPlotView(QVariantMap m, QWidget *parent);
 
     virtual void addData(const QVector<double> &data);
+    virtual void addColumns(const QVector<QVector<double> > &columns);
 
 private:
     Q_INVOKABLE void uiTaskRequest(QVariantMap params);
 
 private:
     int _x_item;
+    bool _autoScale;    // realtime: fit both axes to the data instead of scrolling
+    double _history;    // realtime: x range kept in the graphs, 0: all
 };
 
 #endif // QCPPLOTVIEW_H
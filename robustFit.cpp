@@ -0,0 +1,97 @@
+/*
+MIT License
+
+Copyright (c) 2021 WagonWheelRobotics
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#include "robustFit.h"
+
+#include <algorithm>
+#include <random>
+
+#include "magApply.h"
+#include "magModel.h"
+#include "parallel.h"
+
+// ellipsoid fit of the masked samples
+static int fitInliers(const magDataSpan &d, const std::vector<uint8_t> &mask, ellipsoidFit &fit, int threads)
+{
+    std::vector<double> x, y, z;
+    for(size_t i=0;i<d.size();i++)
+    {
+        if(!mask[i]) continue;
+        x.push_back(d.x[i]);
+        y.push_back(d.y[i]);
+        z.push_back(d.z[i]);
+    }
+    fit.clear();
+    fit.add(magDataSpan{nullptr, x.data(), y.data(), z.data(), nullptr, x.size()}, threads);
+    return fit.solve();
+}
+
+size_t robustFit(const magDataSpan &data, double threshold, int hypotheses, std::vector<uint8_t> &mask, ellipsoidFit &fit, int threads)
+{
+    const size_t n=data.size();
+    mask.assign(n, 0);
+    if(n<ROBUST_FIT_MIN_SAMPLES || hypotheses<1) return 0;
+
+    // hypotheses, scored over all samples
+    std::vector<size_t> score(hypotheses, 0);
+    std::vector<std::vector<double> > k(hypotheses);
+    parallel::forEach((size_t)hypotheses, [&](size_t h, int)
+    {
+        std::mt19937_64 rng(ROBUST_FIT_SEED + h);
+        std::uniform_int_distribution<size_t> pick(0, n-1);
+        ellipsoidFit f;
+        for(int i=0;i<ROBUST_FIT_MIN_SAMPLES;i++)
+        {
+            const size_t j=pick(rng);
+            f.add(data.x[j], data.y[j], data.z[j]);
+        }
+        if(!f.solve()) return;
+
+        k[h].resize(magModelAffine::nParams);
+        f.affine(k[h].data());
+        score[h] = magApplyInliers(MAG_MODEL_AFFINE, k[h].data(), data, threshold, nullptr, 1);
+    }, threads);
+
+    const size_t best=std::max_element(score.begin(), score.end()) - score.begin();
+    if(score[best]<ROBUST_FIT_MIN_SAMPLES) return 0;
+    size_t count=magApplyInliers(MAG_MODEL_AFFINE, k[best].data(), data, threshold, mask.data(), threads);
+
+    // local optimization: refit the inliers
+    if(!fitInliers(data, mask, fit, threads)) return 0;
+    std::vector<uint8_t> m(n);
+    for(int r=0;r<ROBUST_FIT_REFINE;r++)
+    {
+        double a[magModelAffine::nParams];
+        fit.affine(a);
+        const size_t c=magApplyInliers(MAG_MODEL_AFFINE, a, data, threshold, m.data(), threads);
+        if(c<=count) break;
+
+        ellipsoidFit f;
+        if(!fitInliers(data, m, f, threads)) break;
+        mask.swap(m);
+        count = c;
+        fit = f;
+    }
+    return count;
+}
@@ -0,0 +1,54 @@
+#ifndef ROBUSTFIT_H
+#define ROBUSTFIT_H
+
+/*
+MIT License
+
+Copyright (c) 2021 WagonWheelRobotics
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "ellipsoidFit.h"
+#include "magDataSet.h"
+
+// RANSAC ellipsoid fit, rejects magnetic disturbances before the nonlinear solve
+//
+// Hypotheses are ellipsoids through minimal sets of 9 random samples (ellipsoidFit,
+// 9 degrees of freedom). A hypothesis is scored by its inlier count over all
+// samples, ||W(raw-c)|-1| <= threshold, with the vectorized apply kernel
+// (magApplyInliers), and the hypotheses are scored in parallel, one per thread.
+// The best one is refined by fitting its inliers while the inlier count grows.
+// Hypotheses are seeded by their index, the result does not depend on the thread count.
+
+#define ROBUST_FIT_HYPOTHESES   256
+#define ROBUST_FIT_THRESHOLD    0.05    // relative to the field magnitude
+#define ROBUST_FIT_MIN_SAMPLES  9
+#define ROBUST_FIT_REFINE       5       // max refinement rounds
+#define ROBUST_FIT_SEED         0x72616e736163ULL
+
+// returns the inlier count, 0 if no hypothesis is an ellipsoid
+// mask: 1 for the inliers, fit: solved ellipsoid fit of the inliers
+size_t robustFit(const magDataSpan &data, double threshold, int hypotheses, std::vector<uint8_t> &mask, ellipsoidFit &fit, int threads=0);
+
+#endif // ROBUSTFIT_H
@@ -4,92 +4,379 @@
 
 #include <ceres/ceres.h>
 #include <ceres/loss_function.h>
+#include <ceres/rotation.h>
+
+#include <Eigen/Dense>
 
-#include <QList>
 #include <QVector>
+#include <QElapsedTimer>
 #include <QDebug>
 
-struct sphereFit
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <vector>
+
+#include "solver.h"
+#include "solverCost.h"
+#include "ellipsoidFit.h"
+#include "magModel.h"
+#include "parallel.h"
+#include "robustFit.h"
+#include "sphereCoverage.h"
+
+#define SPHERE_FIT_BLOCK        4096    // max residuals per batched cost function
+#define SPHERE_FIT_BLOCK_MIN    256     // min residuals per batched cost function
+#define SPHERE_FIT_BLOCKS_PER_THREAD 4  // residual blocks per thread, for load balancing
+
+#define SOLVER_DENSE_MAX_PARAMS 100     // auto linear solver: dense up to this parameter count
+
+solverOptions::solverOptions()
+{
+    threads = 0;
+    linearSolver = SOLVER_LINEAR_AUTO;
+    trustRegion = SOLVER_TRUST_REGION_LM;
+    maxIterations = 1000;
+    cellSamples = 0;
+    covariance = 0;
+    robust = 0;
+    robustThreshold = ROBUST_FIT_THRESHOLD;
+    verbose = 1;
+}
+
+QVariantMap solverOptions::toVariant() const
+{
+    QVariantMap m;
+    m["threads"] = threads;
+    m["linearSolver"] = linearSolver;
+    m["trustRegion"] = trustRegion;
+    m["maxIterations"] = maxIterations;
+    m["cellSamples"] = cellSamples;
+    m["covariance"] = covariance;
+    m["robust"] = robust;
+    m["robustThreshold"] = robustThreshold;
+    return m;
+}
+
+solverOptions solverOptions::fromVariant(const QVariantMap &m)
+{
+    solverOptions o;
+    if(m.contains("threads")) o.threads = std::max(0, m["threads"].toInt());
+    if(m.contains("linearSolver")) o.linearSolver = std::min(std::max(0, m["linearSolver"].toInt()), SOLVER_LINEAR_SPARSE_NORMAL_CHOLESKY);
+    if(m.contains("trustRegion")) o.trustRegion = std::min(std::max(0, m["trustRegion"].toInt()), SOLVER_TRUST_REGION_DOGLEG);
+    if(m.contains("maxIterations")) o.maxIterations = std::max(1, m["maxIterations"].toInt());
+    if(m.contains("cellSamples")) o.cellSamples = std::max(0, m["cellSamples"].toInt());
+    if(m.contains("covariance")) o.covariance = m["covariance"].toInt() ? 1 : 0;
+    if(m.contains("robust")) o.robust = m["robust"].toInt() ? 1 : 0;
+    if(m.contains("robustThreshold")) o.robustThreshold = std::min(std::max(1e-4, m["robustThreshold"].toDouble()), 1.0);
+    return o;
+}
+
+QStringList solverOptions::linearSolverNames()
+{
+    return QStringList{"Auto", "Dense QR", "Dense normal Cholesky", "Sparse normal Cholesky"};
+}
+
+QStringList solverOptions::trustRegionNames()
+{
+    return QStringList{"Levenberg-Marquardt", "Dogleg"};
+}
+
+solverReport::solverReport()
 {
-    sphereFit(double raw_x, double raw_y, double raw_z)
+    samples = 0;
+    iterations = 0;
+    initialCost = 0.0;
+    finalCost = 0.0;
+    timeMs = 0.0;
+    canceled = 0;
+    cached = 0;
+    inliers = 0;
+}
+
+QVariantMap solverReport::toVariant() const
+{
+    QVariantMap m;
+    m["samples"] = (qulonglong)samples;
+    m["iterations"] = iterations;
+    m["initialCost"] = initialCost;
+    m["finalCost"] = finalCost;
+    m["timeMs"] = timeMs;
+    m["brief"] = brief;
+    if(inliers) m["inliers"] = (qulonglong)inliers;
+    if(!covariance.isEmpty())
     {
-        raw[0] = raw_x;
-        raw[1] = raw_y;
-        raw[2] = raw_z;
+        QVariantList c, s;
+        for(auto v:covariance) c.append(v);
+        for(auto v:sigma()) s.append(v);
+        m["covariance"] = c;
+        m["sigma"] = s;
     }
+    return m;
+}
 
-    template <typename T>
-    bool operator()(
-        const T *const k,               // 9: calib parameters
-        T *residuals) const
+solverReport solverReport::fromVariant(const QVariantMap &m)
+{
+    solverReport r;
+    r.samples = (size_t)m.value("samples").toULongLong();
+    r.iterations = m.value("iterations").toInt();
+    r.initialCost = m.value("initialCost").toDouble();
+    r.finalCost = m.value("finalCost").toDouble();
+    r.timeMs = m.value("timeMs").toDouble();
+    r.brief = m.value("brief").toString();
+    r.inliers = (size_t)m.value("inliers").toULongLong();
+    for(const auto &v:m.value("covariance").toList()) r.covariance.append(v.toDouble());
+    return r;
+}
+
+QVector<double> solverReport::sigma() const
+{
+    QVector<double> s;
+    const int n=(int)std::lround(std::sqrt((double)covariance.size()));
+    if(n*n!=covariance.size()) return s;
+    for(int i=0;i<n;i++) s.append(std::sqrt(std::max(0.0, covariance[i*n+i])));
+    return s;
+}
+
+// a single small parameter block: the dense solvers do not pay for the sparse symbolic analysis
+static void setSolverOptions(const solverOptions &options, int nParams, ceres::Solver::Options &solOptions)
+{
+    solOptions.max_num_iterations = options.maxIterations;
+    solOptions.num_threads = parallel::threads(options.threads);
+
+    switch(options.linearSolver)
     {
-        // second order
-        // cor = a * raw^2 + b * raw + c
-        T cor_x = k[0] * (T)raw[0] * (T)raw[0] + k[1] * (T)raw[0] + k[2];
-        T cor_y = k[3] * (T)raw[1] * (T)raw[1] + k[4] * (T)raw[1] + k[5];
-        T cor_z = k[6] * (T)raw[2] * (T)raw[2] + k[7] * (T)raw[2] + k[8];
+    case SOLVER_LINEAR_DENSE_QR:
+        solOptions.linear_solver_type = ceres::DENSE_QR;
+        break;
+    case SOLVER_LINEAR_DENSE_NORMAL_CHOLESKY:
+        solOptions.linear_solver_type = ceres::DENSE_NORMAL_CHOLESKY;
+        break;
+    case SOLVER_LINEAR_SPARSE_NORMAL_CHOLESKY:
+        solOptions.linear_solver_type = ceres::SPARSE_NORMAL_CHOLESKY;
+        solOptions.sparse_linear_algebra_library_type = ceres::SUITE_SPARSE;
+        break;
+    default:
+        if(nParams<=SOLVER_DENSE_MAX_PARAMS)
+        {
+            solOptions.linear_solver_type = ceres::DENSE_NORMAL_CHOLESKY;
+        }
+        else
+        {
+            solOptions.linear_solver_type = ceres::SPARSE_NORMAL_CHOLESKY;
+            solOptions.sparse_linear_algebra_library_type = ceres::SUITE_SPARSE;
+        }
+        break;
+    }
 
-        T sphere = cor_x * cor_x + cor_y * cor_y + cor_z * cor_z;
+    solOptions.trust_region_strategy_type = options.trustRegion==SOLVER_TRUST_REGION_DOGLEG ? ceres::DOGLEG : ceres::LEVENBERG_MARQUARDT;
+}
 
-        residuals[0] = sphere - 1.0;
-        return true;
+// forwards the iterations to a solverCallback
+// stopping terminates "successfully", so ceres keeps the parameters of the last accepted step
+class solverIterationCallback : public ceres::IterationCallback
+{
+public:
+    explicit solverIterationCallback(const solverCallback &callback) : _callback(callback)
+    {
     }
 
-    static ceres::CostFunction *Create(double raw_x, double raw_y, double raw_z)
+    virtual ceres::CallbackReturnType operator()(const ceres::IterationSummary &summary)
     {
-        return (new ceres::AutoDiffCostFunction<sphereFit, 1, 9>(
-            new sphereFit(raw_x, raw_y, raw_z))
-            );
+        if(_callback(summary.iteration, summary.cost, summary.gradient_norm)) return ceres::SOLVER_CONTINUE;
+        return ceres::SOLVER_TERMINATE_SUCCESSFULLY;
     }
 
-    double raw[3];
+private:
+    const solverCallback &_callback;
 };
 
+// enough residual blocks to keep all threads busy
+static int blockSize(size_t n, int threads)
+{
+    size_t b=(n + (size_t)threads*SPHERE_FIT_BLOCKS_PER_THREAD - 1) / ((size_t)threads*SPHERE_FIT_BLOCKS_PER_THREAD);
+    return (int)std::min<size_t>(SPHERE_FIT_BLOCK, std::max<size_t>(SPHERE_FIT_BLOCK_MIN, b));
+}
+
+// covariance: computed at the solution when not null, empty if the Jacobian is rank deficient
+template <class M>
+static int solveBatch(const magDataSpan &d, double *cal,
+                      const solverOptions &options, const solverCallback &callback, ceres::Solver::Summary &summary,
+                      QVector<double> *covariance=nullptr)
+{
+    ceres::Solver::Options solOptions;
+    setSolverOptions(options, M::nParams, solOptions);
+
+    solverIterationCallback cb(callback);
+    if(callback) solOptions.callbacks.push_back(&cb);
+    else if(options.verbose) solOptions.minimizer_progress_to_stdout = true;
+
+    ceres::Problem problem;
+    problem.AddParameterBlock(cal,M::nParams);
+
+    const int n=(int)d.size();
+    const int block=blockSize(d.size(), solOptions.num_threads);
+    for(int i=0;i<n;i+=block)
+    {
+        int len=std::min(block, n-i);
+        problem.AddResidualBlock(new sphereFitBatch<M>(d.x+i, d.y+i, d.z+i, len, SPHERE_FIT_HUBER), nullptr, cal);
+    }
+    addGauge<M>(problem, cal, d.size());
+
+    ceres::Solve(solOptions, &problem, &summary);
+    if(!summary.IsSolutionUsable()) return 0;
+
+    // (J^T J)^-1 scaled by the residual variance 2*cost/(n-p)
+    if(covariance!=nullptr)
+    {
+        covariance->clear();
+        ceres::Covariance::Options covOptions;
+        covOptions.num_threads = solOptions.num_threads;
+        ceres::Covariance cov(covOptions);
+        std::vector<std::pair<const double*, const double*> > blocks{{cal, cal}};
+        double c[M::nParams*M::nParams];
+        if(d.size()>(size_t)M::nParams && cov.Compute(blocks, &problem) && cov.GetCovarianceBlock(cal, cal, c))
+        {
+            const double s2=2.0*summary.final_cost/(double)(d.size()-M::nParams);
+            for(int i=0;i<M::nParams*M::nParams;i++) covariance->append(c[i]*s2);
+        }
+    }
+    return 1;
+}
+
 
 // sphere fitting
 
-int solve(QList<QList<double> > &dataSet, double t0, double t1, QVector<double> &k)
+template <class M>
+static int solveModel(const magDataSpan &dataSet, double t0, double t1, QVector<double> &k, int fastMode, const solverOptions &options,
+                      const solverCallback &callback, const QVector<double> &initial, solverReport *report)
 {
-    ceres::Problem problem;
-    ceres::Covariance::Options covOptions;
+    double cal[M::nParams];
+    M::identity(cal);
 
-    double cal[9]={0.0, 1.0,0.0, 0.0,1.0,0.0, 0.0,1.0,0.0};  // 3x  y=axx+bx+c
+    QElapsedTimer timer;
+    timer.start();
 
-    ceres::LossFunction *loss = new ceres::HuberLoss(1.0);
+    // samples in the time range, the columns are used in place by the batched cost function
+    magDataSpan d=dataSet.range(t0, t1);
+    ellipsoidFit fit;
+    fit.add(d, options.threads);
 
-    problem.AddParameterBlock(&cal[0],9);
+    std::vector<double> x, y, z;    // decimated samples
 
-    int n=0;
-    for(const auto &i:dataSet)
+    // robust pre-stage, the closed-form fit and the solver see the inliers only
+    std::vector<double> ix, iy, iz;
+    if(options.robust)
     {
-        ceres::CostFunction *cost_function;
-        auto time = i.at(0);
-        if(t0<time && time<t1)
+        std::vector<uint8_t> mask;
+        ellipsoidFit rfit;
+        const size_t n0=d.size();
+        const size_t nIn=robustFit(d, options.robustThreshold, ROBUST_FIT_HYPOTHESES, mask, rfit, options.threads);
+        if(nIn)
         {
-            cost_function = sphereFit::Create(i.at(1), i.at(2), i.at(3));
-            problem.AddResidualBlock(cost_function, loss, &cal[0]);
-            n++;
+            for(size_t i=0;i<n0;i++)
+            {
+                if(!mask[i]) continue;
+                ix.push_back(d.x[i]);
+                iy.push_back(d.y[i]);
+                iz.push_back(d.z[i]);
+            }
+            d = magDataSpan{nullptr, ix.data(), iy.data(), iz.data(), nullptr, ix.size()};
+            fit = rfit;
+            if(report!=nullptr)
+            {
+                report->inliers = nIn;
+                report->inlierMask = std::move(mask);
+            }
+            if(options.verbose)
+            {
+                qInfo() << "RANSAC:" << nIn << "inliers of" << n0 << "samples in" << timer.nsecsElapsed()*1e-6 << "ms";
+            }
+        }
+        else if(options.verbose)
+        {
+            qWarning() << "RANSAC found no ellipsoid, all samples are used";
         }
     }
 
-    if(n)
+    // closed-form initial guess, or the given warm start
+    int init=fit.solve();
+    if(initial.size()==M::nParams)
     {
-        ceres::Solver::Options solOptions;
-        solOptions.max_num_iterations = 1000;
-        solOptions.linear_solver_type = ceres::SPARSE_NORMAL_CHOLESKY;
-        solOptions.sparse_linear_algebra_library_type = ceres::SUITE_SPARSE;
-        solOptions.num_threads = 1;
-        solOptions.minimizer_progress_to_stdout = true;
+        std::copy(initial.begin(), initial.end(), cal);
+    }
+    else if(init)
+    {
+        M::initial(fit, cal);
+        if(options.verbose)
+        {
+            qInfo() << "Closed-form ellipsoid fit:" << "center" << fit.center()[0] << fit.center()[1] << fit.center()[2]
+                    << "in" << timer.nsecsElapsed()*1e-6 << "ms";
+        }
+    }
+    else if(options.verbose)
+    {
+        qWarning() << "Closed-form ellipsoid fit failed, starting from the identity";
+    }
+
+    if(init)
+    {
+        // orientation coverage, optionally a bounded number of samples per cell
+        sphereCoverage grid;
+        grid.bin(d.x, d.y, d.z, d.size(), fit.center(), fit.softIron(), options.threads);
+        if(options.verbose)
+        {
+            qInfo() << "Sphere coverage" << grid.coverage()*100.0 << "% (" << grid.occupied() << "of" << grid.cells() << "cells )";
+        }
+        if(options.cellSamples>0)
+        {
+            const size_t n0=d.size();
+            grid.select(d.x, d.y, d.z, options.cellSamples, x, y, z);
+            d = magDataSpan{nullptr, x.data(), y.data(), z.data(), nullptr, x.size()};
+            if(options.verbose)
+            {
+                qInfo() << "Decimated" << n0 << "->" << d.size() << "samples," << options.cellSamples << "per cell";
+            }
+        }
+    }
+
+    k.clear();
+    if(fastMode)
+    {
+        if(!init) return 0;
+        for(int i=0;i<M::nParams;i++) k.append(cal[i]);
+        return 1;
+    }
+
+    if(d.size())
+    {
+        timer.restart();
 
         ceres::Solver::Summary summary;
-        ceres::Solve(solOptions, &problem, &summary);
+        QVector<double> covariance;
+        int r=solveBatch<M>(d, cal, options, callback, summary, options.covariance && report!=nullptr ? &covariance : nullptr);
 
-        qInfo() << summary.FullReport().c_str();
+        if(report!=nullptr)
+        {
+            report->samples = d.size();
+            report->iterations = (int)summary.iterations.size();
+            report->initialCost = summary.initial_cost;
+            report->finalCost = summary.final_cost;
+            report->timeMs = timer.nsecsElapsed()*1e-6;
+            report->canceled = summary.termination_type==ceres::USER_SUCCESS ? 1 : 0;
+            report->brief = QString::fromStdString(summary.BriefReport());
+            report->covariance = covariance;
+        }
+
+        if(options.verbose)
+        {
+            qInfo() << summary.FullReport().c_str();
+            qInfo() << d.size() << "samples are solved in" << timer.nsecsElapsed()*1e-6 << "ms," << M::name() << "model";
+        }
 
-        k.clear();
-        if (summary.IsSolutionUsable())
+        if (r)
         {
-            for(int i=0;i<9;i++)
+            for(int i=0;i<M::nParams;i++)
             {
                 k.append(cal[i]);
             }
@@ -99,3 +386,280 @@ int solve(QList<QList<double> > &dataSet, double t0, double t1, QVector<double>
 
     return 0;
 }
+
+int solve(const magDataSpan &dataSet, double t0, double t1, QVector<double> &k, int model, int fastMode, const solverOptions &options,
+          const solverCallback &callback, const QVector<double> &initial, solverReport *report)
+{
+    int r=0;
+    if(!magModelDispatch(model, [&](auto m){r=solveModel<decltype(m)>(dataSet, t0, t1, k, fastMode, options, callback, initial, report);}))
+    {
+        qWarning() << "Unknown calibration model" << model;
+    }
+    return r;
+}
+
+// joint calibration
+
+// alignment of a block of synchronous samples, 3 residuals per sample
+// R_s*cor_s - cor_0, both sensors corrected with their own parameters
+template <class M>
+struct jointAlign
+{
+    jointAlign(const magDataSpan &ref, const magDataSpan &sensor, size_t pos, int n)
+        : x0(ref.x+pos), y0(ref.y+pos), z0(ref.z+pos), xs(sensor.x+pos), ys(sensor.y+pos), zs(sensor.z+pos), n(n)
+    {
+    }
+
+    template <typename T>
+    bool operator()(
+        const T *const k0,              // M::nParams: reference sensor
+        const T *const ks,              // M::nParams: this sensor
+        const T *const r,               // 3: angle-axis
+        T *residuals) const
+    {
+        T R[9];     // column major
+        ceres::AngleAxisToRotationMatrix(r, R);
+
+        for(int i=0;i<n;i++)
+        {
+            T c0x, c0y, c0z, csx, csy, csz;
+            M::apply(k0, (T)x0[i], (T)y0[i], (T)z0[i], c0x, c0y, c0z);
+            M::apply(ks, (T)xs[i], (T)ys[i], (T)zs[i], csx, csy, csz);
+
+            T *res=residuals+3*i;
+            res[0] = R[0]*csx + R[3]*csy + R[6]*csz - c0x;
+            res[1] = R[1]*csx + R[4]*csy + R[7]*csz - c0y;
+            res[2] = R[2]*csx + R[5]*csy + R[8]*csz - c0z;
+        }
+        return true;
+    }
+
+    static ceres::CostFunction *Create(const magDataSpan &ref, const magDataSpan &sensor, size_t pos, int n)
+    {
+        return (new ceres::AutoDiffCostFunction<jointAlign, ceres::DYNAMIC, M::nParams, M::nParams, 3>(
+            new jointAlign(ref, sensor, pos, n), 3*n)
+            );
+    }
+
+    const double *x0, *y0, *z0;
+    const double *xs, *ys, *zs;
+    int n;
+};
+
+// rotation which maps the corrected samples of a sensor onto the reference (Kabsch)
+template <class M>
+static void jointInitialRotation(const magDataSpan &ref, const magDataSpan &sensor, const double *k0, const double *ks, double *r)
+{
+    Eigen::Matrix3d H=Eigen::Matrix3d::Zero();
+    for(size_t i=0;i<ref.size();i++)
+    {
+        Eigen::Vector3d c0, cs;
+        M::apply(k0, ref.x[i], ref.y[i], ref.z[i], c0[0], c0[1], c0[2]);
+        M::apply(ks, sensor.x[i], sensor.y[i], sensor.z[i], cs[0], cs[1], cs[2]);
+        H += cs*c0.transpose();
+    }
+
+    Eigen::JacobiSVD<Eigen::Matrix3d> svd(H, Eigen::ComputeFullU|Eigen::ComputeFullV);
+    const double d = (svd.matrixV()*svd.matrixU().transpose()).determinant()<0.0 ? -1.0 : 1.0;
+    const Eigen::Matrix3d R = svd.matrixV() * Eigen::Vector3d(1.0, 1.0, d).asDiagonal() * svd.matrixU().transpose();
+
+    const Eigen::AngleAxisd a(R);
+    for(int i=0;i<3;i++) r[i] = a.angle()*a.axis()[i];
+}
+
+// no decimation or robust stage, they would break the row correspondence between the sensors
+template <class M>
+static int solveJointModel(const std::vector<magDataSpan> &sensors, double t0, double t1,
+                           std::vector<QVector<double> > &k, std::vector<QVector<double> > &rotation,
+                           const solverOptions &options, const solverCallback &callback, solverReport *report)
+{
+    k.clear();
+    rotation.clear();
+
+    const size_t nSensors=sensors.size();
+    if(nSensors==0) return 0;
+
+    std::vector<magDataSpan> d;
+    for(const auto &s:sensors) d.push_back(s.range(t0, t1));
+    const size_t n=d[0].size();
+    for(const auto &s:d)
+    {
+        if(s.size()!=n)
+        {
+            qWarning() << "Joint calibration: the sensors have different sample counts";
+            return 0;
+        }
+    }
+    if(n==0) return 0;
+
+    QElapsedTimer timer;
+    timer.start();
+
+    // per sensor closed-form fit, then the rotations between the corrected frames
+    std::vector<double> cal(nSensors*M::nParams);
+    std::vector<double> rot(nSensors*3, 0.0);
+    for(size_t s=0;s<nSensors;s++)
+    {
+        double *ks=cal.data()+s*M::nParams;
+        ellipsoidFit fit;
+        fit.add(d[s], options.threads);
+        if(fit.solve())
+        {
+            M::initial(fit, ks);
+        }
+        else
+        {
+            M::identity(ks);
+            if(options.verbose) qWarning() << "Closed-form ellipsoid fit of sensor" << s << "failed, starting from the identity";
+        }
+    }
+    for(size_t s=1;s<nSensors;s++)
+    {
+        jointInitialRotation<M>(d[0], d[s], cal.data(), cal.data()+s*M::nParams, rot.data()+3*s);
+    }
+    if(options.verbose)
+    {
+        qInfo() << "Joint initial guess of" << nSensors << "sensors in" << timer.nsecsElapsed()*1e-6 << "ms";
+    }
+
+    ceres::Solver::Options solOptions;
+    const int nParams=(int)(nSensors*M::nParams + (nSensors-1)*3);
+    setSolverOptions(options, nParams, solOptions);
+    if(options.linearSolver==SOLVER_LINEAR_AUTO && nSensors>2)
+    {
+        // dense cost grows with the cube of the sensor count, the arrow pattern stays linear
+        solOptions.linear_solver_type = ceres::SPARSE_NORMAL_CHOLESKY;
+        solOptions.sparse_linear_algebra_library_type = ceres::SUITE_SPARSE;
+    }
+
+    solverIterationCallback cb(callback);
+    if(callback) solOptions.callbacks.push_back(&cb);
+    else if(options.verbose) solOptions.minimizer_progress_to_stdout = true;
+
+    ceres::Problem problem;
+    const int block=blockSize(n, solOptions.num_threads);
+    for(size_t s=0;s<nSensors;s++)
+    {
+        double *ks=cal.data()+s*M::nParams;
+        problem.AddParameterBlock(ks, M::nParams);
+        for(size_t i=0;i<n;i+=block)
+        {
+            const int len=(int)std::min<size_t>(block, n-i);
+            problem.AddResidualBlock(new sphereFitBatch<M>(d[s].x+i, d[s].y+i, d[s].z+i, len, SPHERE_FIT_HUBER), nullptr, ks);
+        }
+        addGauge<M>(problem, ks, n);
+    }
+    for(size_t s=1;s<nSensors;s++)
+    {
+        double *ks=cal.data()+s*M::nParams;
+        double *rs=rot.data()+3*s;
+        problem.AddParameterBlock(rs, 3);
+        for(size_t i=0;i<n;i+=block)
+        {
+            const int len=(int)std::min<size_t>(block, n-i);
+            problem.AddResidualBlock(jointAlign<M>::Create(d[0], d[s], i, len), nullptr, cal.data(), ks, rs);
+        }
+    }
+
+    timer.restart();
+    ceres::Solver::Summary summary;
+    ceres::Solve(solOptions, &problem, &summary);
+
+    if(report!=nullptr)
+    {
+        report->samples = n*nSensors;
+        report->iterations = (int)summary.iterations.size();
+        report->initialCost = summary.initial_cost;
+        report->finalCost = summary.final_cost;
+        report->timeMs = timer.nsecsElapsed()*1e-6;
+        report->canceled = summary.termination_type==ceres::USER_SUCCESS ? 1 : 0;
+        report->brief = QString::fromStdString(summary.BriefReport());
+    }
+    if(options.verbose)
+    {
+        qInfo() << summary.FullReport().c_str();
+        qInfo() << n << "samples x" << nSensors << "sensors are solved in" << timer.nsecsElapsed()*1e-6 << "ms," << M::name() << "model";
+    }
+    if(!summary.IsSolutionUsable()) return 0;
+
+    for(size_t s=0;s<nSensors;s++)
+    {
+        QVector<double> ks(M::nParams), rs(3);
+        std::copy(cal.begin()+s*M::nParams, cal.begin()+(s+1)*M::nParams, ks.begin());
+        std::copy(rot.begin()+3*s, rot.begin()+3*(s+1), rs.begin());
+        k.push_back(ks);
+        rotation.push_back(rs);
+    }
+    return 1;
+}
+
+int solveJoint(const std::vector<magDataSpan> &sensors, double t0, double t1,
+               std::vector<QVector<double> > &k, std::vector<QVector<double> > &rotation, int model,
+               const solverOptions &options, const solverCallback &callback, solverReport *report)
+{
+    int r=0;
+    if(!magModelDispatch(model, [&](auto m){r=solveJointModel<decltype(m)>(sensors, t0, t1, k, rotation, options, callback, report);}))
+    {
+        qWarning() << "Unknown calibration model" << model;
+    }
+    return r;
+}
+
+// Windows are split into one contiguous chain per thread. A chain is solved in
+// time order, each window starting from the solution of the previous one, so
+// only the first window of a chain needs the closed-form initial guess.
+// counted once, the start of window i is t0+i*stride and does not accumulate rounding
+size_t solveSweepWindows(double t0, double t1, double width, double stride)
+{
+    if(!(width>0.0) || !(stride>0.0) || !(t1-t0>=width)) return 0;
+    const double n=std::floor((t1-t0-width)/stride)+1.0;
+    if(!(n<=SOLVER_SWEEP_MAX_WINDOWS)) return 0;
+    return (size_t)n;
+}
+
+int solveSweep(const magDataSpan &dataSet, double t0, double t1, double width, double stride, int model,
+               const solverOptions &options, std::vector<solverWindow> &windows, const solverProgress &progress)
+{
+    windows.clear();
+    const size_t n=solveSweepWindows(t0, t1, width, stride);
+    if(n==0)
+    {
+        qWarning() << "No sliding windows, or more than" << SOLVER_SWEEP_MAX_WINDOWS;
+        return 0;
+    }
+    windows.resize(n);
+    for(size_t i=0;i<n;i++)
+    {
+        solverWindow &w=windows[i];
+        w.t0 = t0 + i*stride;
+        w.t1 = w.t0 + width;
+        w.result = 0;
+    }
+
+    const size_t nChain=std::min<size_t>(n, (size_t)parallel::threads(options.threads));
+    const size_t chainLength=(n+nChain-1)/nChain;
+
+    solverOptions windowOptions=options;
+    windowOptions.threads = 1;      // parallel over the chains
+    windowOptions.verbose = 0;
+
+    std::atomic<size_t> solved(0);
+    std::atomic<bool> cancel(false);
+    parallel::forEach(nChain, [&](size_t c, int)
+    {
+        QVector<double> warm;
+        const size_t end=std::min(n, (c+1)*chainLength);
+        for(size_t i=c*chainLength; i<end && !cancel; i++)
+        {
+            solverWindow &w=windows[i];
+            w.result = solve(dataSet.range(w.t0, w.t1), w.t0, w.t1, w.k, model, 0, windowOptions,
+                             [&](int, double, double){return !cancel;}, warm);
+            warm = w.result ? w.k : QVector<double>();
+
+            size_t done=++solved;
+            if(progress && !progress(done, n)) cancel = true;
+        }
+    }, options.threads);
+
+    return cancel ? 0 : 1;
+}
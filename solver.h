@@ -0,0 +1,139 @@
+#ifndef SOLVER_H
+#define SOLVER_H
+
+/*
+MIT License
+
+Copyright (c) 2021 WagonWheelRobotics
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#include <QVector>
+#include <QVariantMap>
+#include <QStringList>
+
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+#include "magDataSet.h"
+#include "magModel.h"
+
+#define SOLVER_LINEAR_AUTO                      0   // dense for small parameter blocks
+#define SOLVER_LINEAR_DENSE_QR                  1
+#define SOLVER_LINEAR_DENSE_NORMAL_CHOLESKY     2
+#define SOLVER_LINEAR_SPARSE_NORMAL_CHOLESKY    3
+
+#define SOLVER_TRUST_REGION_LM                  0
+#define SOLVER_TRUST_REGION_DOGLEG              1
+
+// nonlinear solver configuration, stored as a QVariantMap (configStorage)
+struct solverOptions
+{
+    int threads;            // residual evaluation threads, 0: all cores
+    int linearSolver;       // SOLVER_LINEAR_*
+    int trustRegion;        // SOLVER_TRUST_REGION_*
+    int maxIterations;
+    int cellSamples;        // samples kept per sphere cell (sphereCoverage), 0: all
+    int covariance;         // 1: parameter covariance of the solution (solverReport)
+    int robust;             // 1: only the RANSAC inliers are solved (robustFit)
+    double robustThreshold; // inlier: ||cor|-1| below this
+    int verbose;            // 0: no log, not stored
+
+    solverOptions();
+
+    QVariantMap toVariant() const;
+    static solverOptions fromVariant(const QVariantMap &m);
+
+    static QStringList linearSolverNames();
+    static QStringList trustRegionNames();
+};
+
+// outcome of a solve (ceres::Solver::Summary), kept with cached results
+struct solverReport
+{
+    size_t samples;         // solved samples, after decimation
+    int iterations;
+    double initialCost;
+    double finalCost;
+    double timeMs;
+    int canceled;           // stopped by the callback
+    int cached;             // 1: cache hit, 2: warm start from a cached window (solverCache)
+    QString brief;          // ceres BriefReport
+    QVector<double> covariance;     // nParams x nParams row major, scaled by the residual variance, empty if not computed
+    size_t inliers;                 // robust: inlier count
+    std::vector<uint8_t> inlierMask;    // robust: 1 for the inliers of the samples in t0<t<t1, not stored
+
+    solverReport();
+
+    QVariantMap toVariant() const;
+    static solverReport fromVariant(const QVariantMap &m);
+
+    QVector<double> sigma() const;  // standard deviations, the diagonal of the covariance
+};
+
+// called after every solver iteration from the solving thread
+// returning false stops the solver, the parameters of the last successful iteration are kept
+typedef std::function<bool(int iteration, double cost, double gradientNorm)> solverCallback;
+
+// return false to cancel, called once per window or resample, concurrently from the solving threads
+typedef std::function<bool(size_t current, size_t total)> solverProgress;
+
+// sphere fitting of the samples in t0<t<t1, the time column must be ascending (magDataSet::isSorted)
+// model: index in magModels, k has magModelParams(model) values
+// fastMode: returns the closed-form ellipsoid fit without the nonlinear refinement
+// initial: warm start instead of the closed-form fit, when it has the parameter count of the model
+// report: optional summary of the nonlinear solve
+int solve(const magDataSpan &dataSet, double t0, double t1, QVector<double> &k, int model=MAG_MODEL_QUADRATIC, int fastMode=0,
+          const solverOptions &options=solverOptions(), const solverCallback &callback=solverCallback(),
+          const QVector<double> &initial=QVector<double>(), solverReport *report=nullptr);
+
+// joint calibration of rigidly mounted sensors sampled together (magLoader::loadSensors)
+// sensors: one span per sensor, the same rows in the same time order
+// k: magModelParams(model) values per sensor
+// rotation: angle-axis (rad) per sensor, cor_0 = R_s * cor_s, the first is zero
+// Every sensor has its own sphere residuals, and every synchronous sample adds
+// R_s*cor_s - cor_0 for s>0. A sensor only couples with the reference sensor,
+// the normal equations have an arrow structure and the sparse Cholesky
+// factorization grows linearly with the sensor count.
+int solveJoint(const std::vector<magDataSpan> &sensors, double t0, double t1,
+               std::vector<QVector<double> > &k, std::vector<QVector<double> > &rotation, int model=MAG_MODEL_QUADRATIC,
+               const solverOptions &options=solverOptions(), const solverCallback &callback=solverCallback(), solverReport *report=nullptr);
+
+struct solverWindow
+{
+    double t0;
+    double t1;
+    int result;
+    QVector<double> k;
+};
+
+#define SOLVER_SWEEP_MAX_WINDOWS    100000
+
+// number of windows [t0+i*stride, t0+i*stride+width] inside [t0,t1], 0 if none fits
+// or there are more than SOLVER_SWEEP_MAX_WINDOWS
+size_t solveSweepWindows(double t0, double t1, double width, double stride);
+
+// sliding window calibration: windows [t0+i*stride, t0+i*stride+width] inside [t0,t1]
+// solved in parallel
+int solveSweep(const magDataSpan &dataSet, double t0, double t1, double width, double stride, int model,
+               const solverOptions &options, std::vector<solverWindow> &windows, const solverProgress &progress=solverProgress());
+
+#endif // SOLVER_H
@@ -0,0 +1,267 @@
+/*
+MIT License
+
+Copyright (c) 2021 WagonWheelRobotics
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#include "solverCache.h"
+
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QLockFile>
+#include <QDateTime>
+#include <QJsonObject>
+#include <QJsonDocument>
+#include <QDebug>
+
+#include <algorithm>
+
+#include "configStorage.h"
+#include "magApply.h"
+#include "magBin.h"
+
+#define SOLVER_CACHE_FOLDER "cache"
+
+// one job at a time in the cache, QLockFile excludes the threads of a process as well.
+// The lock file is next to the cache folder, so clear() can remove the folder.
+class cacheLock
+{
+public:
+    cacheLock() : _lock(QDir::cleanPath(configStorage(SOLVER_CACHE_FOLDER, nullptr).getFolder())+".lock")
+    {
+        QDir().mkpath(QFileInfo(_lock.fileName()).absolutePath());
+        _locked = _lock.tryLock(SOLVER_CACHE_LOCK_MS);
+        if(!_locked) qWarning() << "The result cache is in use by another job, it is skipped";
+    }
+
+    bool isLocked() const {return _locked;}
+
+private:
+    QLockFile _lock;
+    bool _locked;
+};
+
+solverCache::solverCache(const magDataSpan &dataSet, int threads)
+{
+    _hash = hashOf(dataSet, threads);
+}
+
+solverCache::solverCache(uint64_t dataHash)
+{
+    _hash = dataHash;
+}
+
+uint64_t solverCache::hashOf(const magDataSpan &dataSet, int threads)
+{
+    // t,x,y,z columns, w is derived
+    const double *col[4]={dataSet.t, dataSet.x, dataSet.y, dataSet.z};
+    uint64_t h[4];
+    for(int i=0;i<4;i++)
+    {
+        h[i] = col[i]!=nullptr ? magbin_hash((const uint8_t*)col[i], dataSet.size()*sizeof(double), threads) : 0;
+    }
+    return magbin_hash((const uint8_t*)h, sizeof(h), 1);
+}
+
+QString solverCache::subFolder() const
+{
+    return QString(SOLVER_CACHE_FOLDER "/%1").arg((qulonglong)_hash, 16, 16, QChar('0'));
+}
+
+// the window is the time of the first and the last solved sample,
+// so requests selecting the same samples share the result
+QVariantMap solverCache::key(const magDataSpan &range, int model, const solverOptions &options)
+{
+    QVariantMap m=options.toVariant();
+    m.remove("threads");
+    m["model"] = magModelNames().value(model);
+    m["first"] = range.t[0];
+    m["last"] = range.t[range.size()-1];
+    m["samples"] = (qulonglong)range.size();
+    return m;
+}
+
+QString solverCache::baseName(const QVariantMap &key)
+{
+    const QByteArray b=QJsonDocument(QJsonObject::fromVariantMap(key)).toJson(QJsonDocument::Compact);
+    return QString("%1").arg((qulonglong)magbin_hash((const uint8_t*)b.constData(), b.size(), 1), 16, 16, QChar('0'));
+}
+
+int solverCache::sameProblem(const QVariantMap &a, const QVariantMap &b)
+{
+    QVariantMap x=a, y=b;
+    for(const auto &w:{"first", "last", "samples"})
+    {
+        x.remove(w);
+        y.remove(w);
+    }
+    return QJsonObject::fromVariantMap(x)==QJsonObject::fromVariantMap(y) ? 1 : 0;
+}
+
+int solverCache::find(const magDataSpan &range, int model, const solverOptions &options, QVector<double> &k, solverReport *report) const
+{
+    if(range.empty()) return 0;
+
+    const QVariantMap request=key(range, model, options);
+    cacheLock lock;
+    if(!lock.isLocked()) return 0;
+    configStorage s(subFolder(), nullptr);
+    const QVariantMap m=s.load(baseName(request));
+    if(m.isEmpty()) return 0;
+
+    // the hash of the key only names the file
+    if(QJsonObject::fromVariantMap(m.value("key").toMap())!=QJsonObject::fromVariantMap(request)) return 0;
+
+    const QVariantList l=m.value("k").toList();
+    if(l.size()!=magModelParams(model)) return 0;
+    k.clear();
+    for(const auto &v:l) k.append(v.toDouble());
+
+    if(report!=nullptr) *report = solverReport::fromVariant(m.value("report").toMap());
+    return 1;
+}
+
+int solverCache::nearest(const magDataSpan &range, int model, const solverOptions &options, QVector<double> &k) const
+{
+    if(range.empty()) return 0;
+
+    const QVariantMap request=key(range, model, options);
+    const double first=range.t[0];
+    const double last=range.t[range.size()-1];
+
+    cacheLock lock;
+    if(!lock.isLocked()) return 0;
+    configStorage s(subFolder(), nullptr);
+    const QStringList entries=QDir(s.getFolder()).entryList(QStringList{"*.json"}, QDir::Files);
+
+    double best=SOLVER_CACHE_MIN_OVERLAP;
+    QVariantList bestK;
+    for(const auto &e:entries)
+    {
+        const QVariantMap m=s.load(QFileInfo(e).completeBaseName());
+        const QVariantMap key=m.value("key").toMap();
+        if(!sameProblem(key, request)) continue;
+
+        const double f=key.value("first").toDouble();
+        const double l=key.value("last").toDouble();
+        const double i=std::min(l, last) - std::max(f, first);
+        const double u=std::max(l, last) - std::min(f, first);
+        const double overlap = u>0.0 ? i/u : 0.0;
+        if(overlap>best)
+        {
+            best = overlap;
+            bestK = m.value("k").toList();
+        }
+    }
+
+    if(bestK.size()!=magModelParams(model)) return 0;
+    k.clear();
+    for(const auto &v:bestK) k.append(v.toDouble());
+    return 1;
+}
+
+int solverCache::store(const magDataSpan &range, int model, const solverOptions &options, const QVector<double> &k, const solverReport &report) const
+{
+    if(range.empty() || k.size()!=magModelParams(model)) return 0;
+
+    const QVariantMap request=key(range, model, options);
+    QVariantList l;
+    for(auto v:k) l.append(v);
+
+    QVariantMap m;
+    m["key"] = request;
+    m["k"] = l;
+    m["report"] = report.toVariant();
+    m["date"] = QDateTime::currentDateTimeUtc().toString(Qt::ISODate);
+
+    cacheLock lock;
+    if(!lock.isLocked()) return 0;
+    configStorage s(subFolder(), nullptr);
+    if(!s.save(m, baseName(request))) return 0;
+    evict();
+    return 1;
+}
+
+// the least recently written results and datasets are removed, under the lock of store()
+void solverCache::evict(void) const
+{
+    QDir d(configStorage(subFolder(), nullptr).getFolder());
+    const QFileInfoList entries=d.entryInfoList(QStringList{"*.json"}, QDir::Files, QDir::Time);
+    for(int i=SOLVER_CACHE_ENTRIES;i<entries.size();i++) QFile::remove(entries[i].absoluteFilePath());
+
+    QDir root(configStorage(SOLVER_CACHE_FOLDER, nullptr).getFolder());
+    const QFileInfoList sets=root.entryInfoList(QDir::Dirs|QDir::NoDotAndDotDot, QDir::Time);
+    for(int i=SOLVER_CACHE_DATASETS;i<sets.size();i++) QDir(sets[i].absoluteFilePath()).removeRecursively();
+}
+
+int solverCache::clear(void)
+{
+    cacheLock lock;
+    if(!lock.isLocked()) return 0;
+    QDir root(configStorage(SOLVER_CACHE_FOLDER, nullptr).getFolder());
+    if(!root.exists()) return 1;
+    return root.removeRecursively() ? 1 : 0;
+}
+
+int solveCached(const magDataSpan &dataSet, double t0, double t1, QVector<double> &k, int model, int fastMode,
+                const solverOptions &options, const solverCallback &callback, solverReport *report, uint64_t *dataHash)
+{
+    if(fastMode || dataSet.empty())
+    {
+        return solve(dataSet, t0, t1, k, model, fastMode, options, callback, QVector<double>(), report);
+    }
+    const magDataSpan range=dataSet.range(t0, t1);
+
+    uint64_t hash = dataHash!=nullptr ? *dataHash : 0;
+    if(hash==0) hash = solverCache::hashOf(dataSet, options.threads);
+    if(dataHash!=nullptr) *dataHash = hash;
+    solverCache cache(hash);
+    solverReport r;
+    if(cache.find(range, model, options, k, &r))
+    {
+        r.cached = 1;
+        if(options.robust)
+        {
+            // the mask is not stored, the inliers of the cached solution are reported instead
+            r.inlierMask.resize(range.size());
+            r.inliers = magApplyInliers(model, k.constData(), range, options.robustThreshold, r.inlierMask.data(), options.threads);
+        }
+        if(options.verbose)
+        {
+            qInfo() << "Cached result," << r.iterations << "iterations, cost" << r.finalCost << "(solved in" << r.timeMs << "ms)";
+        }
+        if(report!=nullptr) *report = r;
+        return 1;
+    }
+
+    QVector<double> warm;
+    if(cache.nearest(range, model, options, warm) && options.verbose)
+    {
+        qInfo() << "Warm start from a cached window";
+    }
+
+    const int ret=solve(dataSet, t0, t1, k, model, 0, options, callback, warm, &r);
+    if(!warm.isEmpty()) r.cached = 2;
+    if(ret && !r.canceled) cache.store(range, model, options, k, r);
+    if(report!=nullptr) *report = r;
+    return ret;
+}
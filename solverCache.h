@@ -0,0 +1,85 @@
+#ifndef SOLVERCACHE_H
+#define SOLVERCACHE_H
+
+/*
+MIT License
+
+Copyright (c) 2021 WagonWheelRobotics
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#include <QString>
+#include <QVariantMap>
+#include <QVector>
+
+#include <cstdint>
+
+#include "solver.h"
+
+// Persistent cache of solved parameters, under the "cache" folder of configStorage.
+// Results are grouped by the content hash of the dataset (one folder per dataset)
+// and stored one JSON file per result, keyed by the solved sample range,
+// the model and the solver options (except the thread count).
+// A result of the same data, model and options but an overlapping window
+// is a good warm start for a new window.
+// Jobs which share the cache (batch threads, several processes) take turns through
+// a lock file next to the cache folder, a job which can not get it sees a miss.
+
+#define SOLVER_CACHE_ENTRIES        256     // results per dataset
+#define SOLVER_CACHE_DATASETS       64
+#define SOLVER_CACHE_MIN_OVERLAP    0.5     // warm start: intersection over union of the windows
+#define SOLVER_CACHE_LOCK_MS        5000    // wait for another job
+
+class solverCache
+{
+public:
+    explicit solverCache(const magDataSpan &dataSet, int threads=0);    // hashes the dataset
+    explicit solverCache(uint64_t dataHash);                            // hashOf() of the dataset
+
+    uint64_t dataHash() const {return _hash;}
+    static uint64_t hashOf(const magDataSpan &dataSet, int threads=0);
+
+    // range: the samples to solve, a part of the dataset
+    int find(const magDataSpan &range, int model, const solverOptions &options, QVector<double> &k, solverReport *report=nullptr) const;
+    int nearest(const magDataSpan &range, int model, const solverOptions &options, QVector<double> &k) const;
+    int store(const magDataSpan &range, int model, const solverOptions &options, const QVector<double> &k, const solverReport &report) const;
+
+    static int clear(void);
+
+private:
+    QString subFolder() const;
+    static QVariantMap key(const magDataSpan &range, int model, const solverOptions &options);
+    static QString baseName(const QVariantMap &key);
+    static int sameProblem(const QVariantMap &a, const QVariantMap &b);  // all but the window
+    void evict(void) const;
+
+private:
+    uint64_t _hash;
+};
+
+// solve() through the cache: a cached result is returned as it is, otherwise the
+// nearest cached window is the warm start and the result is stored.
+// fastMode is not cached.
+// dataHash: solverCache::hashOf(dataSet) kept by the caller with the data, 0 is hashed here and written back
+int solveCached(const magDataSpan &dataSet, double t0, double t1, QVector<double> &k, int model=MAG_MODEL_QUADRATIC, int fastMode=0,
+                const solverOptions &options=solverOptions(), const solverCallback &callback=solverCallback(),
+                solverReport *report=nullptr, uint64_t *dataHash=nullptr);
+
+#endif // SOLVERCACHE_H
@@ -0,0 +1,175 @@
+#ifndef SOLVERCOST_H
+#define SOLVERCOST_H
+
+/*
+MIT License
+
+Copyright (c) 2021 WagonWheelRobotics
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#include <ceres/ceres.h>
+
+#include <algorithm>
+#include <cmath>
+
+#include "magModel.h"
+
+// Cost functions of the sphere fit |cor|^2 = 1, shared by solver.cpp and tests/solver.
+// sphereFit is the AutoDiff form with one residual block per sample, the solver
+// uses sphereFitBatch with the analytic jacobian. tests/solver checks that both
+// give the same jacobian and the same solution.
+
+#define SPHERE_FIT_HUBER        1.0     // scale of huber loss
+
+template <class M>
+struct sphereFit
+{
+    sphereFit(double raw_x, double raw_y, double raw_z)
+    {
+        raw[0] = raw_x;
+        raw[1] = raw_y;
+        raw[2] = raw_z;
+    }
+
+    template <typename T>
+    bool operator()(
+        const T *const k,               // M::nParams: calib parameters
+        T *residuals) const
+    {
+        T cor_x, cor_y, cor_z;
+        M::apply(k, (T)raw[0], (T)raw[1], (T)raw[2], cor_x, cor_y, cor_z);
+
+        T sphere = cor_x * cor_x + cor_y * cor_y + cor_z * cor_z;
+
+        residuals[0] = sphere - 1.0;
+        return true;
+    }
+
+    static ceres::CostFunction *Create(double raw_x, double raw_y, double raw_z)
+    {
+        return (new ceres::AutoDiffCostFunction<sphereFit, 1, M::nParams>(
+            new sphereFit(raw_x, raw_y, raw_z))
+            );
+    }
+
+    double raw[3];
+};
+
+// Same model as sphereFit, but one cost function evaluates a block of samples
+// with the analytic jacobian in a single loop over contiguous arrays.
+//
+// The huber loss is applied per sample inside the cost function:
+// the residual is g = sign(f) * sqrt(rho(f^2)), so 0.5*g^2 = 0.5*rho(f^2)
+// and the cost is identical to AddResidualBlock(sphereFit, HuberLoss) per sample.
+template <class M>
+class sphereFitBatch : public ceres::CostFunction
+{
+public:
+    sphereFitBatch(const double *x, const double *y, const double *z, int n, double huber)
+        : _x(x), _y(y), _z(z), _n(n), _huber(huber)
+    {
+        set_num_residuals(n);
+        mutable_parameter_block_sizes()->push_back(M::nParams);
+    }
+
+    virtual bool Evaluate(double const *const *parameters, double *residuals, double **jacobians) const
+    {
+        const double *k=parameters[0];
+        const double *__restrict x=_x;
+        const double *__restrict y=_y;
+        const double *__restrict z=_z;
+        const double delta=_huber;
+        const double delta2=_huber*_huber;
+        double *__restrict J = jacobians!=nullptr ? jacobians[0] : nullptr;
+
+        for(int i=0;i<_n;i++)
+        {
+            double cx, cy, cz;
+            M::apply(k, x[i], y[i], z[i], cx, cy, cz);
+            const double f = cx*cx + cy*cy + cz*cz - 1.0;
+
+            // huber: inlier g=f, outlier g=sign(f)*sqrt(2*delta*|f|-delta^2)
+            const double a = std::abs(f);
+            const bool inlier = a<=delta;
+            const double r = inlier ? 1.0 : std::sqrt(2.0*delta*a - delta2);
+            const double g = inlier ? f : std::copysign(r, f);
+            const double s = inlier ? 2.0 : 2.0*delta/r;    // 2 * dg/df
+
+            residuals[i] = g;
+
+            if(J!=nullptr)
+            {
+                M::gradient(k, x[i], y[i], z[i], s*cx, s*cy, s*cz, J+M::nParams*i);
+            }
+        }
+        return true;
+    }
+
+private:
+    const double *_x;
+    const double *_y;
+    const double *_z;
+    int _n;
+    double _huber;
+};
+
+// W -> R*W leaves |cor| unchanged, the penalty keeps W symmetric
+class affineGauge : public ceres::SizedCostFunction<3, magModelAffine::nParams>
+{
+public:
+    explicit affineGauge(double weight) : _w(weight)
+    {
+    }
+
+    virtual bool Evaluate(double const *const *parameters, double *residuals, double **jacobians) const
+    {
+        const double *k=parameters[0];
+        residuals[0] = _w*(k[1]-k[3]);
+        residuals[1] = _w*(k[2]-k[6]);
+        residuals[2] = _w*(k[5]-k[7]);
+        if(jacobians!=nullptr && jacobians[0]!=nullptr)
+        {
+            double *J=jacobians[0];
+            std::fill(J, J+3*magModelAffine::nParams, 0.0);
+            J[0*magModelAffine::nParams+1] =  _w;
+            J[0*magModelAffine::nParams+3] = -_w;
+            J[1*magModelAffine::nParams+2] =  _w;
+            J[1*magModelAffine::nParams+6] = -_w;
+            J[2*magModelAffine::nParams+5] =  _w;
+            J[2*magModelAffine::nParams+7] = -_w;
+        }
+        return true;
+    }
+
+private:
+    double _w;
+};
+
+template <class M> inline void addGauge(ceres::Problem &, double *, size_t)
+{
+}
+
+template <> inline void addGauge<magModelAffine>(ceres::Problem &problem, double *cal, size_t n)
+{
+    problem.AddResidualBlock(new affineGauge(std::sqrt((double)n)), nullptr, cal);
+}
+
+#endif // SOLVERCOST_H
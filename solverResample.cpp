@@ -0,0 +1,232 @@
+/*
+MIT License
+
+Copyright (c) 2021 WagonWheelRobotics
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#include "solverResample.h"
+
+#include <QDebug>
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <random>
+#include <vector>
+
+#include "magModel.h"
+#include "parallel.h"
+
+solverResample::solverResample()
+{
+    mode = SOLVER_RESAMPLE_BOOTSTRAP;
+    count = 0;
+    solved = 0;
+    inSampleRms = 0.0;
+    outOfSampleRms = 0.0;
+    outOfSampleRmsSigma = 0.0;
+}
+
+QVariantMap solverResample::toVariant() const
+{
+    auto list=[](const QVector<double> &v)
+    {
+        QVariantList l;
+        for(auto x:v) l.append(x);
+        return l;
+    };
+
+    QVariantMap m;
+    m["mode"] = modeNames().value(mode);
+    m["count"] = count;
+    m["solved"] = solved;
+    m["mean"] = list(mean);
+    m["sigma"] = list(sigma);
+    m["lower"] = list(lower);
+    m["upper"] = list(upper);
+    m["inSampleRms"] = inSampleRms;
+    m["outOfSampleRms"] = outOfSampleRms;
+    m["outOfSampleRmsSigma"] = outOfSampleRmsSigma;
+    return m;
+}
+
+QStringList solverResample::modeNames()
+{
+    return QStringList{"Bootstrap", "K-fold"};
+}
+
+// linear interpolation between the order statistics, v is sorted
+static double percentile(const std::vector<double> &v, double p)
+{
+    const double x=p*(double)(v.size()-1);
+    const size_t i=(size_t)x;
+    if(i+1>=v.size()) return v.back();
+    return v[i] + (x-(double)i)*(v[i+1]-v[i]);
+}
+
+static void meanSigma(const std::vector<double> &v, double &mean, double &sigma)
+{
+    mean = 0.0;
+    sigma = 0.0;
+    if(v.empty()) return;
+    for(auto x:v) mean += x;
+    mean /= (double)v.size();
+    if(v.size()<2) return;
+    for(auto x:v) sigma += (x-mean)*(x-mean);
+    sigma = std::sqrt(sigma/(double)(v.size()-1));
+}
+
+static double rms(int model, const QVector<double> &k, const std::vector<double> &x, const std::vector<double> &y, const std::vector<double> &z)
+{
+    double r=std::numeric_limits<double>::quiet_NaN();
+    if(x.empty()) return r;
+    magModelDispatch(model, [&](auto m){r=magModelRms<decltype(m)>(k.constData(), x.data(), y.data(), z.data(), x.size());});
+    return r;
+}
+
+int solveResample(const magDataSpan &dataSet, double t0, double t1, int model, int mode, int count,
+                  const solverOptions &options, solverResample &result, const solverProgress &progress)
+{
+    result = solverResample();
+    result.mode = mode;
+    result.count = count;
+
+    const magDataSpan d=dataSet.range(t0, t1);
+    const int nParams=magModelParams(model);
+    const size_t n=d.size();
+    if(nParams==0 || count<2 || n<(size_t)(2*count) || (mode!=SOLVER_RESAMPLE_BOOTSTRAP && mode!=SOLVER_RESAMPLE_KFOLD)) return 0;
+
+    const double inf=std::numeric_limits<double>::infinity();
+    solverOptions o=options;
+    o.verbose = 0;
+    o.covariance = 0;
+
+    // the solution of all samples is the warm start of the resamples, cancel stops it too
+    if(!solve(dataSet, t0, t1, result.k, model, 0, o, [&](int, double, double){return !progress || progress(0, (size_t)count);})) return 0;
+    magModelDispatch(model, [&](auto m){result.inSampleRms=magModelRms<decltype(m)>(result.k.constData(), d.x, d.y, d.z, d.size());});
+
+    // k-fold: fold of every sample, balanced and shuffled
+    std::vector<int> fold;
+    if(mode==SOLVER_RESAMPLE_KFOLD)
+    {
+        fold.resize(n);
+        for(size_t i=0;i<n;i++) fold[i] = (int)(i%(size_t)count);
+        std::mt19937_64 rng(SOLVER_RESAMPLE_SEED);
+        std::shuffle(fold.begin(), fold.end(), rng);
+    }
+
+    // per worker buffers, training samples keep the time order (solve() selects by time)
+    struct buffer
+    {
+        std::vector<double> t, x, y, z;     // training
+        std::vector<double> hx, hy, hz;     // held out
+        std::vector<uint32_t> hits;
+    };
+    const int nWorker=std::min(parallel::threads(options.threads), count);
+    std::vector<buffer> buf(nWorker);
+
+    std::vector<QVector<double> > k(count);
+    std::vector<int> ok(count, 0);
+    std::vector<double> residual(count, std::numeric_limits<double>::quiet_NaN());
+    o.threads = 1;      // parallel over the resamples
+
+    std::atomic<size_t> finished(0);
+    std::atomic<bool> cancel(false);
+    parallel::forEach((size_t)count, [&](size_t r, int worker)
+    {
+        if(cancel) return;
+
+        buffer &b=buf[worker];
+        b.t.clear(); b.x.clear(); b.y.clear(); b.z.clear();
+        b.hx.clear(); b.hy.clear(); b.hz.clear();
+
+        auto train=[&](size_t i)
+        {
+            b.t.push_back(d.t[i]);
+            b.x.push_back(d.x[i]);
+            b.y.push_back(d.y[i]);
+            b.z.push_back(d.z[i]);
+        };
+        auto hold=[&](size_t i)
+        {
+            b.hx.push_back(d.x[i]);
+            b.hy.push_back(d.y[i]);
+            b.hz.push_back(d.z[i]);
+        };
+
+        if(mode==SOLVER_RESAMPLE_BOOTSTRAP)
+        {
+            std::mt19937_64 rng(SOLVER_RESAMPLE_SEED + r);
+            std::uniform_int_distribution<size_t> pick(0, n-1);
+            b.hits.assign(n, 0);
+            for(size_t i=0;i<n;i++) b.hits[pick(rng)]++;
+            for(size_t i=0;i<n;i++)
+            {
+                if(b.hits[i]==0) hold(i);
+                for(uint32_t j=0;j<b.hits[i];j++) train(i);
+            }
+        }
+        else
+        {
+            for(size_t i=0;i<n;i++)
+            {
+                if(fold[i]==(int)r) hold(i);
+                else train(i);
+            }
+        }
+
+        const magDataSpan s{b.t.data(), b.x.data(), b.y.data(), b.z.data(), nullptr, b.t.size()};
+        ok[r] = solve(s, -inf, inf, k[r], model, 0, o, [&](int, double, double){return !cancel;}, result.k);
+        if(ok[r]) residual[r] = rms(model, k[r], b.hx, b.hy, b.hz);
+
+        const size_t done=++finished;
+        if(progress && !progress(done, (size_t)count)) cancel = true;
+    }, nWorker);
+
+    if(cancel) return 0;
+
+    // statistics over the successful resamples
+    std::vector<std::vector<double> > p(nParams);
+    std::vector<double> res;
+    for(int r=0;r<count;r++)
+    {
+        if(!ok[r] || k[r].size()!=nParams) continue;
+        result.solved++;
+        for(int i=0;i<nParams;i++) p[i].push_back(k[r][i]);
+        if(std::isfinite(residual[r])) res.push_back(residual[r]);
+    }
+    if(result.solved<2) return 0;
+
+    for(int i=0;i<nParams;i++)
+    {
+        double mean, sigma;
+        meanSigma(p[i], mean, sigma);
+        std::sort(p[i].begin(), p[i].end());
+        result.mean.append(mean);
+        result.sigma.append(sigma);
+        result.lower.append(percentile(p[i], 0.025));
+        result.upper.append(percentile(p[i], 0.975));
+    }
+    meanSigma(res, result.outOfSampleRms, result.outOfSampleRmsSigma);
+    return 1;
+}
@@ -0,0 +1,76 @@
+#ifndef SOLVERRESAMPLE_H
+#define SOLVERRESAMPLE_H
+
+/*
+MIT License
+
+Copyright (c) 2021 WagonWheelRobotics
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#include <QVector>
+#include <QVariantMap>
+#include <QStringList>
+
+#include "solver.h"
+
+// Parameter uncertainty by resampling
+//
+// Bootstrap: count solves of n samples drawn with replacement, the residuals are
+// evaluated on the samples which are not drawn (out-of-bag).
+// K-fold: the samples are shuffled into count folds, every fold is held out once
+// and the residuals are evaluated on it. The spread of k-fold parameters is
+// smaller than the bootstrap one since the training sets overlap.
+//
+// The resamples are solved in parallel, one per thread, all starting from the
+// solution of all samples, and seeded per resample so the result does not
+// depend on the thread count.
+
+#define SOLVER_RESAMPLE_BOOTSTRAP   0
+#define SOLVER_RESAMPLE_KFOLD       1
+
+#define SOLVER_RESAMPLE_SEED        0x6d616743616cULL
+
+struct solverResample
+{
+    int mode;                   // SOLVER_RESAMPLE_*
+    int count;                  // resamples or folds
+    int solved;                 // successful resamples
+
+    QVector<double> k;          // solution of all samples
+    QVector<double> mean;       // per parameter, over the resamples
+    QVector<double> sigma;
+    QVector<double> lower;      // 95% percentile interval
+    QVector<double> upper;
+
+    double inSampleRms;         // of k, rms of |cor|-1
+    double outOfSampleRms;      // mean over the resamples
+    double outOfSampleRmsSigma;
+
+    solverResample();
+
+    QVariantMap toVariant() const;
+    static QStringList modeNames();
+};
+
+int solveResample(const magDataSpan &dataSet, double t0, double t1, int model, int mode, int count,
+                  const solverOptions &options, solverResample &result, const solverProgress &progress=solverProgress());
+
+#endif // SOLVERRESAMPLE_H
@@ -0,0 +1,105 @@
+/*
+MIT License
+
+Copyright (c) 2021 WagonWheelRobotics
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#include "sphereCoverage.h"
+
+#include <algorithm>
+#include <cmath>
+
+#include "parallel.h"
+
+#define SPHERE_COVERAGE_CHUNK   65536
+
+sphereCoverage::sphereCoverage(int bands)
+{
+    _bands = std::max(1, bands);
+}
+
+int sphereCoverage::cell(double ux, double uy, double uz) const
+{
+    const int sectors=2*_bands;
+    int b=(int)std::floor((uz+1.0)*0.5*_bands);
+    int s=(int)std::floor((std::atan2(uy,ux)+M_PI)*(0.5/M_PI)*sectors);
+    b = std::min(std::max(b,0),_bands-1);
+    s = std::min(std::max(s,0),sectors-1);
+    return b*sectors + s;
+}
+
+void sphereCoverage::bin(const double *x, const double *y, const double *z, size_t n,
+                         const Eigen::Vector3d &c, const Eigen::Matrix3d &W, int threads)
+{
+    _count.assign(cells(), 0);
+    _id.resize(n);
+
+    std::vector<int> &id=_id;
+    const size_t nChunk=(n+SPHERE_COVERAGE_CHUNK-1)/SPHERE_COVERAGE_CHUNK;
+    parallel::forEach(nChunk, [&](size_t k, int)
+    {
+        const size_t end=std::min(n,(k+1)*SPHERE_COVERAGE_CHUNK);
+        for(size_t i=k*SPHERE_COVERAGE_CHUNK;i<end;i++)
+        {
+            const Eigen::Vector3d u=W*(Eigen::Vector3d(x[i],y[i],z[i])-c);
+            const double r=u.norm();
+            id[i] = r>0.0 && std::isfinite(r) ? cell(u[0]/r,u[1]/r,u[2]/r) : -1;
+        }
+    }, threads);
+
+    for(size_t i=0;i<n;i++) if(id[i]>=0) _count[id[i]]++;
+}
+
+// keeps `cap` of `count` samples of a cell: the samples where floor(seen*cap/count) steps
+size_t sphereCoverage::select(const double *x, const double *y, const double *z, int cap,
+                              std::vector<double> &ox, std::vector<double> &oy, std::vector<double> &oz) const
+{
+    ox.clear();
+    oy.clear();
+    oz.clear();
+    if(cap<=0) return 0;
+
+    std::vector<uint32_t> seen(cells(), 0);
+    for(size_t i=0;i<_id.size();i++)
+    {
+        const int id=_id[i];
+        if(id<0) continue;
+        const uint64_t cnt=_count[id];
+        const uint64_t s=seen[id]++;
+        if(((s+1)*cap)/cnt != (s*cap)/cnt)
+        {
+            ox.push_back(x[i]);
+            oy.push_back(y[i]);
+            oz.push_back(z[i]);
+        }
+    }
+    return ox.size();
+}
+
+int sphereCoverage::occupied() const
+{
+    return (int)std::count_if(_count.begin(), _count.end(), [](uint32_t c){return c>0;});
+}
+
+double sphereCoverage::coverage() const
+{
+    return _count.empty() ? 0.0 : (double)occupied()/_count.size();
+}
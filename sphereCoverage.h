@@ -0,0 +1,69 @@
+#ifndef SPHERECOVERAGE_H
+#define SPHERECOVERAGE_H
+
+/*
+MIT License
+
+Copyright (c) 2021 WagonWheelRobotics
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#include <Eigen/Core>
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Equal area grid on the unit sphere
+//
+// The sphere is cut into bands of equal height in z, which have equal area
+// (Archimedes), and each band into 2*bands sectors of equal longitude,
+// so all cells have the same area like HEALPix pixels.
+// Samples are mapped onto the sphere with an ellipsoid fit, u = W (raw - c) / |W (raw - c)|,
+// counted per cell, and a cell keeps at most `cap` samples evenly spaced in time.
+
+#define SPHERE_COVERAGE_BANDS   32      // 32 x 64 = 2048 cells, ~20 square degrees each
+
+class sphereCoverage
+{
+public:
+    explicit sphereCoverage(int bands=SPHERE_COVERAGE_BANDS);
+
+    int cells() const {return 2*_bands*_bands;}
+    int cell(double ux, double uy, double uz) const;
+
+    // counts n samples per cell
+    void bin(const double *x, const double *y, const double *z, size_t n,
+             const Eigen::Vector3d &c, const Eigen::Matrix3d &W, int threads=0);
+
+    // copies at most cap samples per cell of the binned samples, returns the number kept
+    size_t select(const double *x, const double *y, const double *z, int cap,
+                  std::vector<double> &ox, std::vector<double> &oy, std::vector<double> &oz) const;
+
+    int occupied() const;           // cells with samples, after bin()
+    double coverage() const;        // occupied / cells
+
+private:
+    int _bands;
+    std::vector<uint32_t> _count;
+    std::vector<int> _id;           // cell of every binned sample, -1 if it can not be mapped
+};
+
+#endif // SPHERECOVERAGE_H
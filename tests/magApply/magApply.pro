@@ -0,0 +1,15 @@
+include(../tests.pri)
+
+TARGET = tst_magApply
+
+INCLUDEPATH += $$MAGCAL $$MAGCAL/magData
+
+HEADERS += \
+    $$MAGCAL/magApply.h \
+    $$MAGCAL/magModel.h \
+    $$MAGCAL/magData/magDataSet.h
+
+SOURCES += \
+    tst_magApply.cpp \
+    $$MAGCAL/magApply.cpp \
+    $$MAGCAL/magData/magDataSet.cpp
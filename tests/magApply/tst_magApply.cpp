@@ -0,0 +1,186 @@
+/*
+MIT License
+
+Copyright (c) 2021 WagonWheelRobotics
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#include <QtTest>
+
+#include <cmath>
+#include <random>
+#include <vector>
+
+#include "magApply.h"
+#include "magDataSet.h"
+#include "magModel.h"
+
+// The SIMD kernel of magApply against the per-sample magModelApply of each model,
+// on lengths around the register width and the parallel chunk size so the
+// vector body, the scalar tail and the chunk borders are all covered.
+
+class tst_magApply : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void applyMatchesScalar();
+    void inliersMatchScalar();
+    void dataSet();
+    void unknownModel();
+};
+
+static const size_t lengths[]={0, 1, 2, 3, 4, 5, 7, 8, 9, 15, 16, 17, 33, 65535, 65536, 65537, 131075};
+
+// random raw samples around a unit sphere, one extra leading sample for an unaligned span
+static magDataSet testData(size_t n)
+{
+    std::mt19937 rng(54321);
+    std::uniform_real_distribution<double> uniform(-1.5, 1.5);
+    magDataSet d;
+    for(size_t i=0;i<n+1;i++) d.append(0.01*i, uniform(rng), uniform(rng), uniform(rng));
+    return d;
+}
+
+// identity of the model plus a small random perturbation
+static std::vector<double> testParams(int model)
+{
+    std::mt19937 rng(777+model);
+    std::uniform_real_distribution<double> uniform(-0.1, 0.1);
+    std::vector<double> k(magModelParams(model));
+    magModelDispatch(model, [&](auto m){decltype(m)::identity(k.data());});
+    for(auto &v:k) v += uniform(rng);
+    return k;
+}
+
+static bool near(double a, double b)
+{
+    return std::abs(a-b) <= 1e-12*(1.0+std::abs(b));
+}
+
+// per sample reference: cor and |cor|
+static void reference(int model, const double *k, const magDataSpan &raw, std::vector<double> &cx, std::vector<double> &cy, std::vector<double> &cz, std::vector<double> &cw)
+{
+    const size_t n=raw.size();
+    cx.assign(n, 0.0);
+    cy.assign(n, 0.0);
+    cz.assign(n, 0.0);
+    cw.assign(n, 0.0);
+    magModelDispatch(model, [&](auto m)
+    {
+        magModelApply<decltype(m)>(k, raw.x, raw.y, raw.z, n, cx.data(), cy.data(), cz.data());
+    });
+    for(size_t i=0;i<n;i++) cw[i] = std::sqrt(cx[i]*cx[i] + cy[i]*cy[i] + cz[i]*cz[i]);
+}
+
+void tst_magApply::applyMatchesScalar()
+{
+    for(int model=0;model<magModelNames().size();model++)
+    {
+        const std::vector<double> k=testParams(model);
+        for(size_t n:lengths)
+        {
+            const magDataSet d=testData(n);
+            const magDataSpan raw=d.span(1, n);
+            std::vector<double> rx, ry, rz, rw;
+            reference(model, k.data(), raw, rx, ry, rz, rw);
+
+            for(int threads:{1, 0})
+            {
+                std::vector<double> cx(n, -1.0), cy(n, -1.0), cz(n, -1.0), cw(n, -1.0);
+                QCOMPARE(magApply(model, k.data(), raw, cx.data(), cy.data(), cz.data(), cw.data(), threads), 1);
+                size_t bad=0;
+                for(size_t i=0;i<n;i++)
+                {
+                    const bool ok=near(cx[i], rx[i]) && near(cy[i], ry[i]) && near(cz[i], rz[i]) && near(cw[i], rw[i]);
+                    bad += ok ? 0 : 1;
+                }
+                if(bad!=0) qWarning() << magModelNames().value(model) << magApplyIsa() << n << "samples" << threads << "threads";
+                QCOMPARE(bad, (size_t)0);
+            }
+        }
+    }
+}
+
+void tst_magApply::inliersMatchScalar()
+{
+    const double threshold=0.25;
+    for(int model=0;model<magModelNames().size();model++)
+    {
+        const std::vector<double> k=testParams(model);
+        for(size_t n:lengths)
+        {
+            const magDataSet d=testData(n);
+            const magDataSpan raw=d.span(1, n);
+            std::vector<double> rx, ry, rz, rw;
+            reference(model, k.data(), raw, rx, ry, rz, rw);
+
+            size_t count=0;
+            std::vector<uint8_t> ref(n);
+            for(size_t i=0;i<n;i++)
+            {
+                ref[i] = std::abs(rw[i]-1.0)<=threshold ? 1 : 0;
+                count += ref[i];
+            }
+
+            for(int threads:{1, 0})
+            {
+                std::vector<uint8_t> mask(n, 2);
+                QCOMPARE(magApplyInliers(model, k.data(), raw, threshold, mask.data(), threads), count);
+                QVERIFY(mask==ref);
+                QCOMPARE(magApplyInliers(model, k.data(), raw, threshold, nullptr, threads), count);
+            }
+        }
+    }
+}
+
+// the magDataSet overload copies the time column and the time base
+void tst_magApply::dataSet()
+{
+    magDataSet raw=testData(100), cor;
+    raw.setTimeBase(1234.5);
+    const std::vector<double> k=testParams(MAG_MODEL_AFFINE);
+    QCOMPARE(magApply(MAG_MODEL_AFFINE, k.data(), raw, cor), 1);
+    QCOMPARE(cor.size(), raw.size());
+    QCOMPARE(cor.timeBase(), 1234.5);
+
+    std::vector<double> rx, ry, rz, rw;
+    reference(MAG_MODEL_AFFINE, k.data(), raw.span(), rx, ry, rz, rw);
+    for(size_t i=0;i<raw.size();i++)
+    {
+        QCOMPARE(cor.t()[i], raw.t()[i]);
+        QVERIFY(near(cor.x()[i], rx[i]));
+        QVERIFY(near(cor.w()[i], rw[i]));
+    }
+}
+
+void tst_magApply::unknownModel()
+{
+    const magDataSet d=testData(10);
+    const double k[16]={0};
+    std::vector<double> cx(10, -1.0), cy(10, -1.0), cz(10, -1.0), cw(10, -1.0);
+    QCOMPARE(magApply(magModelNames().size(), k, d.span(1, 10), cx.data(), cy.data(), cz.data(), cw.data()), 0);
+    QCOMPARE(cx[0], -1.0);
+    QCOMPARE(magApplyInliers(-1, k, d.span(1, 10), 0.1), (size_t)0);
+}
+
+QTEST_APPLESS_MAIN(tst_magApply)
+
+#include "tst_magApply.moc"
@@ -0,0 +1,18 @@
+include(../tests.pri)
+
+TARGET = tst_magBin
+
+INCLUDEPATH += $$MAGCAL/magData
+
+HEADERS += \
+    $$MAGCAL/magData/magBin.h \
+    $$MAGCAL/magData/magDataSet.h \
+    $$MAGCAL/magData/magLoader.h \
+    $$MAGCAL/magData/magLogParser.h
+
+SOURCES += \
+    tst_magBin.cpp \
+    $$MAGCAL/magData/magBin.cpp \
+    $$MAGCAL/magData/magDataSet.cpp \
+    $$MAGCAL/magData/magLoader.cpp \
+    $$MAGCAL/magData/magLogParser.cpp
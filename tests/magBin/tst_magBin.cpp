@@ -0,0 +1,333 @@
+/*
+MIT License
+
+Copyright (c) 2021 WagonWheelRobotics
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#include <QtTest>
+#include <QFile>
+#include <QTemporaryDir>
+
+#include <cstring>
+#include <string>
+
+#include "magBin.h"
+#include "magDataSet.h"
+#include "magLoader.h"
+
+class tst_magBin : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void roundTrip();
+    void roundTripFloat();
+    void sourceCheck();
+    void corruptedHeader();
+    void sidecarName();
+    void staleSidecar();
+    void loaderCache();
+    void loaderCacheSensors();
+};
+
+static magDataSet testData(size_t n)
+{
+    magDataSet d;
+    d.setTimeBase(1.6e9);
+    for(size_t i=0;i<n;i++) d.append(i*0.01, 0.1*i, -0.2*i, 1.0/(i+1));
+    return d;
+}
+
+static bool same(const magDataSet &a, const magDataSet &b)
+{
+    if(a.size()!=b.size() || a.timeBase()!=b.timeBase()) return false;
+    const size_t n=a.size()*sizeof(double);
+    return std::memcmp(a.t(), b.t(), n)==0 && std::memcmp(a.x(), b.x(), n)==0 && std::memcmp(a.y(), b.y(), n)==0
+        && std::memcmp(a.z(), b.z(), n)==0 && std::memcmp(a.w(), b.w(), n)==0;
+}
+
+static bool writeFile(const QString &fileName, const std::string &text)
+{
+    QFile f(fileName);
+    if(!f.open(QIODevice::WriteOnly | QIODevice::Truncate)) return false;
+    const bool ok = f.write(text.data(), (qint64)text.size())==(qint64)text.size();
+    f.close();
+    return ok;
+}
+
+static bool patch(const QString &fileName, qint64 pos, const void *p, qint64 n)
+{
+    QFile f(fileName);
+    if(!f.open(QIODevice::ReadWrite)) return false;
+    const bool ok = f.seek(pos) && f.write((const char*)p, n)==n;
+    f.close();
+    return ok;
+}
+
+void tst_magBin::roundTrip()
+{
+    QTemporaryDir dir;
+    QVERIFY(dir.isValid());
+    const QString name=dir.filePath("a.magbin");
+
+    const magDataSet d=testData(1001);
+    const magbin_source_t source={12345, 0x0123456789abcdefULL};
+    QVERIFY(export_magbin(name, d, 4, source));
+
+    magDataSet r;
+    int columns=0;
+    QVERIFY(import_magbin(name, r, source, &columns));
+    QCOMPARE(columns, 4);
+    QVERIFY(same(d, r));
+
+    // an empty dataset is a valid file
+    QVERIFY(export_magbin(name, magDataSet(), 4, source));
+    QVERIFY(import_magbin(name, r, source));
+    QVERIFY(r.empty());
+}
+
+void tst_magBin::roundTripFloat()
+{
+    QTemporaryDir dir;
+    QVERIFY(dir.isValid());
+    const QString name=dir.filePath("f.magbin");
+
+    const magDataSet d=testData(100);
+    const magbin_source_t none={0, 0};
+    QVERIFY(export_magbin(name, d, 4, none, MAGBIN_TYPE_FLOAT));
+
+    magDataSet r;
+    QVERIFY(import_magbin(name, r, none));
+    QCOMPARE(r.size(), d.size());
+    QCOMPARE(r.timeBase(), d.timeBase());
+    for(size_t i=0;i<d.size();i++)
+    {
+        QCOMPARE(r.x()[i], (double)(float)d.x()[i]);
+        QCOMPARE(r.w()[i], (double)(float)d.w()[i]);
+    }
+}
+
+void tst_magBin::sourceCheck()
+{
+    QTemporaryDir dir;
+    QVERIFY(dir.isValid());
+    const QString name=dir.filePath("log.csv.magbin");
+
+    const magDataSet d=testData(10);
+    const magbin_source_t source={100, 42};
+    QVERIFY(export_magbin(name, d, 4, source));
+
+    magDataSet r;
+    const magbin_source_t size={101, 42}, hash={100, 43};
+    QVERIFY(!import_magbin(name, r, size));
+    QVERIFY(!import_magbin(name, r, hash));
+    QVERIFY(import_magbin(name, r));        // any source
+    QVERIFY(same(d, r));
+    QVERIFY(!import_magbin(dir.filePath("missing.magbin"), r));
+}
+
+// every broken field is rejected, none of them reads past the end of the file
+void tst_magBin::corruptedHeader()
+{
+    QTemporaryDir dir;
+    QVERIFY(dir.isValid());
+    const QString name=dir.filePath("c.magbin");
+    const magDataSet d=testData(1000);
+    const magbin_source_t none={0, 0};
+
+    struct corruption
+    {
+        qint64 pos;
+        uint64_t value;
+        int size;
+    };
+    const corruption cases[]=
+    {
+        {0, 'X', 1},                    // magic
+        {8, MAGBIN_VERSION+1, 4},       // version
+        {12, 64, 4},                    // header size
+        {20, 7, 4},                     // value type
+        {24, 1001, 8},                  // rows, one more than the file holds
+        {24, 1ULL<<61, 8},              // rows*8 overflows
+        {24, ~0ULL, 8},
+        {56+8*4, 1ULL<<40, 8},          // w column after the end of the file
+        {56+8*2, 1000*8+128+8, 8},      // z column not 64 byte aligned
+        {56, 0, 8},                     // t column inside the header
+    };
+    for(const auto &c:cases)
+    {
+        QVERIFY(export_magbin(name, d, 4, none));
+        uint8_t v[8];
+        for(int i=0;i<8;i++) v[i] = (uint8_t)(c.value>>(8*i));
+        QVERIFY(patch(name, c.pos, v, c.size));
+
+        magDataSet r;
+        QVERIFY2(!import_magbin(name, r, none), QByteArray::number(c.pos).constData());
+    }
+
+    // truncated file
+    QVERIFY(export_magbin(name, d, 4, none));
+    {
+        QFile f(name);
+        QVERIFY(f.open(QIODevice::ReadWrite));
+        QVERIFY(f.resize(f.size()-8));
+        f.close();
+    }
+    magDataSet r;
+    QVERIFY(!import_magbin(name, r, none));
+
+    // shorter than a header
+    QVERIFY(writeFile(name, "MAGBIN1"));
+    QVERIFY(!import_magbin(name, r, none));
+}
+
+void tst_magBin::sidecarName()
+{
+    QCOMPARE(magbin_sidecar("dir/log.csv"), QString("dir/log.csv.magbin"));
+    QCOMPARE(magbin_sidecar("dir/log.csv", 0), QString("dir/log.csv.magbin"));
+    QCOMPARE(magbin_sidecar("dir/log.csv", 2), QString("dir/log.csv.s2.magbin"));
+    QCOMPARE(magbin_source_log("dir/log.csv.magbin"), QString("dir/log.csv"));
+    QCOMPARE(magbin_source_log("dir/log.csv.s2.magbin"), QString("dir/log.csv"));
+    QCOMPARE(magbin_source_log("dir/log.csv"), QString());
+}
+
+// a sidecar opened by itself is checked against the log next to it
+void tst_magBin::staleSidecar()
+{
+    QTemporaryDir dir;
+    QVERIFY(dir.isValid());
+    const QString name=dir.filePath("log.csv");
+
+    std::string text="t,x,y,z\n";
+    for(int i=0;i<100;i++) text += std::to_string(i) + "," + std::to_string(i) + ",1,2\n";
+    QVERIFY(writeFile(name, text));
+
+    magLoader loader;
+    magDataSet d;
+    QCOMPARE(loader.load(name, d), (size_t)100);
+    QCOMPARE(magbin_stale(magbin_sidecar(name)), 0);
+
+    // same size, other bytes
+    text[text.size()-2]='3';
+    QVERIFY(writeFile(name, text));
+    QCOMPARE(magbin_stale(magbin_sidecar(name)), 1);
+
+    // still loaded from the sidecar
+    QCOMPARE(loader.load(magbin_sidecar(name), d), (size_t)100);
+    QCOMPARE(d.z()[99], 2.0);
+
+    text += "100,100,1,2\n";
+    QVERIFY(writeFile(name, text));
+    QCOMPARE(magbin_stale(magbin_sidecar(name)), 1);
+
+    // the sensor sidecar of the same log
+    const magbin_source_t source={12345, 42};
+    QVERIFY(export_magbin(magbin_sidecar(name, 1), d, 4, source));
+    QCOMPARE(magbin_stale(magbin_sidecar(name, 1)), 1);
+
+    // no log next to it
+    QVERIFY(QFile(name).remove());
+    QCOMPARE(magbin_stale(magbin_sidecar(name)), 0);
+
+    // a recording has no source
+    const QString rec=dir.filePath("rec.magbin");
+    const magbin_source_t none={0, 0};
+    QVERIFY(export_magbin(rec, d, 4, none));
+    QVERIFY(writeFile(dir.filePath("rec"), "t,x,y,z\n"));
+    QCOMPARE(magbin_stale(rec), 0);
+}
+
+// the second load reads the sidecar, a changed log is parsed again
+void tst_magBin::loaderCache()
+{
+    QTemporaryDir dir;
+    QVERIFY(dir.isValid());
+    const QString name=dir.filePath("log.csv");
+
+    std::string text="t,x,y,z\n";
+    for(int i=0;i<500;i++) text += std::to_string(100+i) + "," + std::to_string(i) + ",1,2\n";
+    text += "99,-1,1,2\n";      // not monotonic
+    QVERIFY(writeFile(name, text));
+
+    magLoader loader;
+    magDataSet a, b, c;
+    QCOMPARE(loader.load(name, a), (size_t)501);
+    QVERIFY(a.isSorted());
+    QCOMPARE(a.x()[0], -1.0);
+    QVERIFY(QFile(magbin_sidecar(name)).exists());
+
+    QCOMPARE(loader.load(name, b), (size_t)501);
+    QVERIFY(same(a, b));
+
+    text += "700,7,1,2\n";
+    QVERIFY(writeFile(name, text));
+    QCOMPARE(loader.load(name, c), (size_t)502);
+    QCOMPARE(c.x()[501], 7.0);
+
+    // the sidecar opened by itself
+    magDataSet d;
+    QCOMPARE(loader.load(magbin_sidecar(name), d), (size_t)502);
+    QVERIFY(same(c, d));
+}
+
+void tst_magBin::loaderCacheSensors()
+{
+    QTemporaryDir dir;
+    QVERIFY(dir.isValid());
+    const QString name=dir.filePath("multi.csv");
+
+    std::string text;
+    for(int i=0;i<300;i++)
+    {
+        const std::string v=std::to_string(i);
+        text += std::to_string(1000-i) + "," + v + ",0,0," + v + ",1,0," + v + ",0,2\n";
+    }
+    QVERIFY(writeFile(name, text));
+
+    magLoader loader;
+    std::vector<magDataSet> a, b;
+    QCOMPARE(loader.loadSensors(name, a), (size_t)300);
+    QCOMPARE(a.size(), (size_t)3);
+    QVERIFY(QFile(magbin_sidecar(name, 2)).exists());
+    QCOMPARE(loader.loadSensors(name, b), (size_t)300);
+    QCOMPARE(b.size(), (size_t)3);
+    for(int s=0;s<3;s++)
+    {
+        QVERIFY(a[s].isSorted());
+        QVERIFY(same(a[s], b[s]));
+    }
+    QCOMPARE(b[1].y()[0], 1.0);
+    QCOMPARE(b[2].x()[0], 299.0);
+
+    // a sensor sidecar which is missing parses the log again
+    QVERIFY(QFile(magbin_sidecar(name, 1)).remove());
+    QCOMPARE(loader.loadSensors(name, b), (size_t)300);
+    QVERIFY(same(a[1], b[1]));
+
+    // sensor 0 only, from the same cache
+    magDataSet s0;
+    QCOMPARE(loader.load(name, s0), (size_t)300);
+    QVERIFY(same(a[0], s0));
+}
+
+QTEST_APPLESS_MAIN(tst_magBin)
+
+#include "tst_magBin.moc"
@@ -0,0 +1,14 @@
+include(../tests.pri)
+
+TARGET = tst_magLogParser
+
+INCLUDEPATH += $$MAGCAL/magData
+
+HEADERS += \
+    $$MAGCAL/magData/magDataSet.h \
+    $$MAGCAL/magData/magLogParser.h
+
+SOURCES += \
+    tst_magLogParser.cpp \
+    $$MAGCAL/magData/magDataSet.cpp \
+    $$MAGCAL/magData/magLogParser.cpp
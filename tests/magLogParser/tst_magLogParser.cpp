@@ -0,0 +1,205 @@
+/*
+MIT License
+
+Copyright (c) 2021 WagonWheelRobotics
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#include <QtTest>
+
+#include <cmath>
+#include <cstdio>
+#include <string>
+
+#include "magLogParser.h"
+
+class tst_magLogParser : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void delimiters();
+    void rejectedRows();
+    void noTimeColumn();
+    void multiSensor();
+    void unsortedTime();
+    void chunks();
+    void cancel();
+};
+
+static size_t parse(magLogParser &log, const std::string &text)
+{
+    return log.parse(text.data(), text.size());
+}
+
+void tst_magLogParser::delimiters()
+{
+    const char candidates[]={',', '\t', ';', ' '};
+    for(auto d:candidates)
+    {
+        std::string text;
+        for(int i=0;i<3;i++)
+        {
+            const std::string sep = d==' ' ? std::string("  ") : std::string(1, d) + " ";
+            text += std::to_string(10+i) + sep + "+1.5" + sep + std::to_string(-i) + sep + "2e1\n";
+        }
+        magLogParser log(1);
+        QCOMPARE(parse(log, text), (size_t)3);
+        QCOMPARE(log.delimiter(), d=='\t' ? ' ' : d);    // a tab is a blank
+        QCOMPARE(log.columns(), 4);
+        QCOMPARE(log.rejected(), (size_t)0);
+
+        const magDataSet data=log.takeDataSet();
+        QCOMPARE(data.size(), (size_t)3);
+        QCOMPARE(data.timeBase(), 10.0);
+        QCOMPARE(data.t()[2], 2.0);
+        QCOMPARE(data.x()[1], 1.5);
+        QCOMPARE(data.y()[2], -2.0);
+        QCOMPARE(data.z()[0], 20.0);
+    }
+}
+
+// wrong column count and a time which is not finite are counted, lines which are not numeric are not
+void tst_magLogParser::rejectedRows()
+{
+    const std::string text=
+        "time,x,y,z\n"
+        "0.0,1,2,3\n"
+        "0.1,1,2\n"
+        "nan,1,2,3\n"
+        "0.2,4,5,6\r\n"
+        "\n"
+        "inf,1,2,3\n"
+        "0.3,7,8,9,\n"
+        "0.4,7,8,9";
+    magLogParser log(1);
+    QCOMPARE(parse(log, text), (size_t)3);
+    QCOMPARE(log.rejected(), (size_t)3);
+
+    const magDataSet data=log.takeDataSet();
+    QCOMPARE(data.size(), (size_t)3);
+    QCOMPARE(data.t()[1], 0.2);
+    QCOMPARE(data.t()[2], 0.4);
+    QCOMPARE(data.x()[2], 7.0);
+    QCOMPARE(data.w()[0], std::sqrt(14.0));
+}
+
+// x,y,z rows, the sample index is the time
+void tst_magLogParser::noTimeColumn()
+{
+    magLogParser log(1);
+    QCOMPARE(parse(log, "1 2 3\n\n4 5 6\n7 8 9\n"), (size_t)3);
+    QCOMPARE(log.columns(), 3);
+    QCOMPARE(log.sensors(), 1);
+
+    const magDataSet data=log.takeDataSet();
+    QCOMPARE(data.timeBase(), 0.0);
+    QCOMPARE(data.t()[0], 0.0);
+    QCOMPARE(data.t()[2], 2.0);
+    QCOMPARE(data.x()[1], 4.0);
+    QCOMPARE(data.z()[2], 9.0);
+}
+
+void tst_magLogParser::multiSensor()
+{
+    magLogParser log(1);
+    QCOMPARE(parse(log, "10,1,2,3,4,5,6\n11,7,8,9,10,11,12\n"), (size_t)2);
+    QCOMPARE(log.sensors(), 2);
+
+    const magDataSet s0=log.takeDataSet(0);
+    const magDataSet s1=log.takeDataSet(1);
+    QVERIFY(log.takeDataSet(2).empty());
+    QCOMPARE(s0.x()[1], 7.0);
+    QCOMPARE(s1.x()[0], 4.0);
+    QCOMPARE(s1.z()[1], 12.0);
+    QCOMPARE(s1.timeBase(), 10.0);
+    QCOMPARE(s1.t()[1], 1.0);
+}
+
+// the parser keeps the order of the file, magLoader sorts
+void tst_magLogParser::unsortedTime()
+{
+    magLogParser log(1);
+    QCOMPARE(parse(log, "3,1,0,0\n1,2,0,0\n2,3,0,0\n"), (size_t)3);
+
+    magDataSet data=log.takeDataSet();
+    QCOMPARE(data.timeBase(), 3.0);
+    QCOMPARE(data.t()[1], -2.0);
+    QVERIFY(!data.isSorted());
+
+    data.sortByTime();
+    QVERIFY(data.isSorted());
+    QCOMPARE(data.x()[0], 2.0);
+    QCOMPARE(data.x()[1], 3.0);
+    QCOMPARE(data.x()[2], 1.0);
+    QCOMPARE(data.w()[2], 1.0);
+}
+
+// a log of many chunks, skipped lines in every chunk move the rows of the chunks after it
+void tst_magLogParser::chunks()
+{
+    const size_t n=600000;
+    std::string text;
+    text.reserve(n*32);
+    size_t rejected=0;
+    char line[96];
+    for(size_t i=0;i<n;i++)
+    {
+        if(i%1000==0) text += "\r\n";
+        if(i%777==0)
+        {
+            text += "1,2\r\n";
+            rejected++;
+        }
+        const int len=std::snprintf(line, sizeof(line), "%zu,%zu,-%zu,%.1f\r\n", i+100, i, i, 0.5*i);
+        text.append(line, len);
+    }
+
+    magLogParser log(4);
+    QCOMPARE(parse(log, text), n);
+    QCOMPARE(log.rejected(), rejected);
+
+    const magDataSet data=log.takeDataSet();
+    QCOMPARE(data.size(), n);
+    QCOMPARE(data.timeBase(), 100.0);
+    size_t bad=0;
+    for(size_t i=0;i<n;i++)
+    {
+        if(data.t()[i]!=(double)i || data.x()[i]!=(double)i || data.y()[i]!=-(double)i || data.z()[i]!=0.5*i) bad++;
+    }
+    QCOMPARE(bad, (size_t)0);
+    QVERIFY(data.isSorted());
+}
+
+void tst_magLogParser::cancel()
+{
+    std::string text;
+    for(int i=0;i<100000;i++) text += std::to_string(i) + ",1,2,3\n";
+
+    magLogParser log(2);
+    log.setProgress([](uint64_t, uint64_t){return false;});
+    QCOMPARE(parse(log, text), (size_t)0);
+    QCOMPARE(log.rows(), (size_t)0);
+    QVERIFY(log.takeDataSet().empty());
+}
+
+QTEST_APPLESS_MAIN(tst_magLogParser)
+
+#include "tst_magLogParser.moc"
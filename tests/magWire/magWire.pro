@@ -0,0 +1,12 @@
+include(../tests.pri)
+
+TARGET = tst_magWire
+
+INCLUDEPATH += $$MAGCAL/magStream
+
+HEADERS += \
+    $$MAGCAL/magStream/magWire.h
+
+SOURCES += \
+    tst_magWire.cpp \
+    $$MAGCAL/magStream/magWire.cpp
@@ -0,0 +1,249 @@
+/*
+MIT License
+
+Copyright (c) 2021 WagonWheelRobotics
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#include <QtTest>
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+#include "magWire.h"
+
+class tst_magWire : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void crc();
+    void roundTrip();
+    void roundTripWide();
+    void byteByByte();
+    void corrupted();
+    void resync();
+    void gaps();
+    void gapsPerSensor();
+    void resetSequence();
+};
+
+static magWireFrame testFrame(int sensor, uint16_t sequence, int count, int wide)
+{
+    magWireFrame f;
+    std::memset(&f, 0, sizeof(f));
+    f.sensor = sensor;
+    f.sequence = sequence;
+    f.t0 = 1600000000000000ull + sequence*1000ull;
+    f.dt = 1000;
+    f.count = count;
+    f.wide = wide;
+    for(int i=0;i<3*count;i++)
+    {
+        // zeros, runs without zeros longer than a COBS block, and both signs
+        const int32_t v=(i%5==0) ? 0 : 0x01010101*(1+i%3)*((i&1) ? -1 : 1);
+        f.xyz[i] = wide ? v : (int32_t)(int16_t)v;
+    }
+    return f;
+}
+
+static std::vector<uint8_t> encode(const magWireFrame &f)
+{
+    std::vector<uint8_t> b(MAG_WIRE_MAX_ENCODED);
+    b.resize(magWireEncode(f, b.data()));
+    return b;
+}
+
+// feeds all bytes, returns the decoded frames
+static std::vector<magWireFrame> decodeAll(magWireDecoder &d, const std::vector<uint8_t> &b, size_t step=0)
+{
+    std::vector<magWireFrame> frames;
+    size_t p=0;
+    while(p<b.size())
+    {
+        const size_t n=step ? std::min(step, b.size()-p) : b.size()-p;
+        magWireFrame f;
+        bool ready;
+        p += d.feed(b.data()+p, n, f, &ready);
+        if(ready) frames.push_back(f);
+    }
+    return frames;
+}
+
+static bool same(const magWireFrame &a, const magWireFrame &b)
+{
+    if(a.sensor!=b.sensor || a.sequence!=b.sequence || a.t0!=b.t0 || a.dt!=b.dt || a.count!=b.count || a.wide!=b.wide) return false;
+    return std::memcmp(a.xyz, b.xyz, 3*a.count*sizeof(int32_t))==0;
+}
+
+void tst_magWire::crc()
+{
+    const char *check="123456789";
+    QCOMPARE(magWireCrc((const uint8_t*)check, 9), (uint16_t)0x29b1);     // CRC-16/CCITT-FALSE
+    QCOMPARE(magWireCrc(nullptr, 0), (uint16_t)0xffff);
+}
+
+void tst_magWire::roundTrip()
+{
+    for(int count=1;count<=MAG_WIRE_MAX_SAMPLES;count++)
+    {
+        const magWireFrame f=testFrame(3, (uint16_t)count, count, 0);
+        const std::vector<uint8_t> b=encode(f);
+        QVERIFY(b.size()<=(size_t)MAG_WIRE_MAX_ENCODED);
+        QCOMPARE(b.back(), (uint8_t)0);
+        QVERIFY(std::find(b.begin(), b.end()-1, 0)==b.end()-1);      // the delimiter is the only zero
+
+        magWireDecoder d;
+        const std::vector<magWireFrame> frames=decodeAll(d, b);
+        QCOMPARE(frames.size(), (size_t)1);
+        QVERIFY(same(frames[0], f));
+        QVERIFY(!d.partial());
+    }
+}
+
+void tst_magWire::roundTripWide()
+{
+    const magWireFrame f=testFrame(255, 0xffff, MAG_WIRE_MAX_SAMPLES, 1);
+    const std::vector<uint8_t> b=encode(f);
+    QVERIFY(b.size()<=(size_t)MAG_WIRE_MAX_ENCODED);
+
+    magWireDecoder d;
+    const std::vector<magWireFrame> frames=decodeAll(d, b);
+    QCOMPARE(frames.size(), (size_t)1);
+    QVERIFY(same(frames[0], f));
+    QCOMPARE(d.frames(), (uint64_t)1);
+    QCOMPARE(d.crcErrors()+d.malformed(), (uint64_t)0);
+}
+
+// a frame split across reads decodes like a whole one
+void tst_magWire::byteByByte()
+{
+    std::vector<uint8_t> b;
+    std::vector<magWireFrame> sent;
+    for(int i=0;i<10;i++)
+    {
+        sent.push_back(testFrame(0, (uint16_t)i, 1+7*i, i&1));
+        const std::vector<uint8_t> e=encode(sent.back());
+        b.insert(b.end(), e.begin(), e.end());
+    }
+    for(size_t step:{(size_t)1, (size_t)3, (size_t)100})
+    {
+        magWireDecoder d;
+        const std::vector<magWireFrame> frames=decodeAll(d, b, step);
+        QCOMPARE(frames.size(), sent.size());
+        for(size_t i=0;i<sent.size();i++) QVERIFY(same(frames[i], sent[i]));
+        QCOMPARE(d.gaps(), (uint64_t)0);
+    }
+}
+
+void tst_magWire::corrupted()
+{
+    const magWireFrame f=testFrame(1, 7, 16, 0);
+    std::vector<uint8_t> b=encode(f);
+    b[b.size()/2] ^= 0x10;
+    if(b[b.size()/2]==0) b[b.size()/2] = 0x55;
+
+    magWireDecoder d;
+    QCOMPARE(decodeAll(d, b).size(), (size_t)0);
+    QCOMPARE(d.crcErrors()+d.malformed(), (uint64_t)1);
+
+    // the next frame is decoded
+    const std::vector<magWireFrame> frames=decodeAll(d, encode(testFrame(1, 8, 16, 0)));
+    QCOMPARE(frames.size(), (size_t)1);
+    QCOMPARE(d.frames(), (uint64_t)1);
+}
+
+// garbage and a cut frame before a valid one
+void tst_magWire::resync()
+{
+    std::vector<uint8_t> b={0x12, 0x34, 0x00};
+    const std::vector<uint8_t> e=encode(testFrame(2, 1, 8, 0));
+    b.insert(b.end(), e.begin(), e.begin()+e.size()/2);
+    b.push_back(0);
+    b.insert(b.end(), e.begin(), e.end());
+
+    magWireDecoder d;
+    const std::vector<magWireFrame> frames=decodeAll(d, b);
+    QCOMPARE(frames.size(), (size_t)1);
+    QVERIFY(same(frames[0], testFrame(2, 1, 8, 0)));
+    QCOMPARE(d.crcErrors()+d.malformed(), (uint64_t)2);
+}
+
+void tst_magWire::gaps()
+{
+    magWireDecoder d;
+    std::vector<uint8_t> b;
+    for(uint16_t s:{0xfffd, 0xfffe, 0x0000, 0x0003, 0x0004})     // wraps, 3 lost after 0
+    {
+        const std::vector<uint8_t> e=encode(testFrame(0, s, 4, 0));
+        b.insert(b.end(), e.begin(), e.end());
+    }
+    QCOMPARE(decodeAll(d, b).size(), (size_t)5);
+    QCOMPARE(d.gaps(), (uint64_t)3);
+
+    // a jump back is a restart of the sender, not lost frames
+    decodeAll(d, encode(testFrame(0, 10, 4, 0)));
+    QCOMPARE(d.gaps(), (uint64_t)8);
+    decodeAll(d, encode(testFrame(0, 5, 4, 0)));
+    QCOMPARE(d.gaps(), (uint64_t)8);
+    decodeAll(d, encode(testFrame(0, 6, 4, 0)));
+    QCOMPARE(d.gaps(), (uint64_t)8);
+}
+
+void tst_magWire::gapsPerSensor()
+{
+    magWireDecoder d;
+    std::vector<uint8_t> b;
+    for(int i=0;i<6;i++)
+    {
+        const std::vector<uint8_t> e=encode(testFrame(i&1, (uint16_t)(100*(i&1)+i/2), 4, 0));
+        b.insert(b.end(), e.begin(), e.end());
+    }
+    QCOMPARE(decodeAll(d, b).size(), (size_t)6);
+    QCOMPARE(d.gaps(), (uint64_t)0);
+}
+
+// a reconnect starts new sequences, the old ones are not compared
+void tst_magWire::resetSequence()
+{
+    magWireDecoder d;
+    decodeAll(d, encode(testFrame(0, 500, 4, 0)));
+
+    // half a frame, then the connection drops
+    const std::vector<uint8_t> e=encode(testFrame(0, 501, 4, 0));
+    decodeAll(d, std::vector<uint8_t>(e.begin(), e.begin()+10));
+    QVERIFY(d.partial());
+    d.reset();
+    QVERIFY(!d.partial());
+
+    const std::vector<magWireFrame> frames=decodeAll(d, encode(testFrame(0, 620, 4, 0)));
+    QCOMPARE(frames.size(), (size_t)1);
+    QCOMPARE(d.gaps(), (uint64_t)0);
+    QCOMPARE(d.frames(), (uint64_t)2);
+
+    decodeAll(d, encode(testFrame(0, 622, 4, 0)));
+    QCOMPARE(d.gaps(), (uint64_t)1);
+}
+
+QTEST_APPLESS_MAIN(tst_magWire)
+
+#include "tst_magWire.moc"
@@ -0,0 +1,25 @@
+include(../tests.pri)
+include(../../thirdParty/ceres/ceres.pri)
+
+TARGET = tst_solver
+
+INCLUDEPATH += $$MAGCAL $$MAGCAL/magData
+
+HEADERS += \
+    $$MAGCAL/ellipsoidFit.h \
+    $$MAGCAL/magApply.h \
+    $$MAGCAL/magModel.h \
+    $$MAGCAL/robustFit.h \
+    $$MAGCAL/solver.h \
+    $$MAGCAL/solverCost.h \
+    $$MAGCAL/sphereCoverage.h \
+    $$MAGCAL/magData/magDataSet.h
+
+SOURCES += \
+    tst_solver.cpp \
+    $$MAGCAL/ellipsoidFit.cpp \
+    $$MAGCAL/magApply.cpp \
+    $$MAGCAL/robustFit.cpp \
+    $$MAGCAL/solver.cpp \
+    $$MAGCAL/sphereCoverage.cpp \
+    $$MAGCAL/magData/magDataSet.cpp
@@ -0,0 +1,302 @@
+/*
+MIT License
+
+Copyright (c) 2021 WagonWheelRobotics
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#include <QtTest>
+#include <QElapsedTimer>
+
+#include <ceres/ceres.h>
+#include <ceres/loss_function.h>
+
+#include <cmath>
+#include <memory>
+#include <random>
+#include <vector>
+
+#include "ellipsoidFit.h"
+#include "magDataSet.h"
+#include "magModel.h"
+#include "solver.h"
+#include "solverCost.h"
+
+// The solver evaluates the sphere fit with sphereFitBatch, the per sample
+// AutoDiffCostFunction<sphereFit> with a HuberLoss is the reference.
+
+class tst_solver : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void jacobian();
+    void solutionQuadratic();
+    void solutionAffine();
+    void solveMatches();
+    void benchmark();
+};
+
+// fixed synthetic log: unit field through a soft iron matrix plus a hard iron offset,
+// gaussian noise and a few percent of outliers
+struct testData
+{
+    std::vector<double> t, x, y, z;
+
+    explicit testData(size_t n)
+    {
+        std::mt19937 rng(12345);
+        std::normal_distribution<double> normal(0.0, 1.0);
+        std::uniform_real_distribution<double> uniform(0.0, 1.0);
+        const double A[9]={1.20, 0.05, -0.03,  0.05, 0.90, 0.02,  -0.03, 0.02, 1.05};
+        const double b[3]={0.30, -0.15, 0.08};
+        t.resize(n);
+        x.resize(n);
+        y.resize(n);
+        z.resize(n);
+        for(size_t i=0;i<n;i++)
+        {
+            double u[3]={normal(rng), normal(rng), normal(rng)};
+            const double l=std::sqrt(u[0]*u[0]+u[1]*u[1]+u[2]*u[2]);
+            const double s=uniform(rng)<0.03 ? 1.0+2.0*uniform(rng) : 1.0;
+            for(int j=0;j<3;j++) u[j]=s*u[j]/l;
+            t[i]=0.01*i;
+            x[i]=A[0]*u[0]+A[1]*u[1]+A[2]*u[2]+b[0]+0.002*normal(rng);
+            y[i]=A[3]*u[0]+A[4]*u[1]+A[5]*u[2]+b[1]+0.002*normal(rng);
+            z[i]=A[6]*u[0]+A[7]*u[1]+A[8]*u[2]+b[2]+0.002*normal(rng);
+        }
+    }
+
+    magDataSpan span() const
+    {
+        return magDataSpan{t.data(), x.data(), y.data(), z.data(), nullptr, x.size()};
+    }
+};
+
+// closed-form start, as solve() does
+template <class M>
+static void initial(const testData &d, double *k)
+{
+    ellipsoidFit fit;
+    fit.add(d.span(), 1);
+    QVERIFY(fit.solve());
+    M::initial(fit, k);
+}
+
+static void tightOptions(ceres::Solver::Options &options)
+{
+    options.max_num_iterations = 500;
+    options.linear_solver_type = ceres::DENSE_QR;
+    options.function_tolerance = 1e-15;
+    options.gradient_tolerance = 1e-14;
+    options.parameter_tolerance = 1e-14;
+    options.num_threads = 1;
+}
+
+// reference: one AutoDiff residual block per sample, huber loss in ceres
+template <class M>
+static void solveAutoDiff(const testData &d, double *k)
+{
+    ceres::Problem problem;
+    ceres::LossFunction *loss = new ceres::HuberLoss(SPHERE_FIT_HUBER);
+    for(size_t i=0;i<d.x.size();i++)
+    {
+        problem.AddResidualBlock(sphereFit<M>::Create(d.x[i], d.y[i], d.z[i]), loss, k);
+    }
+    addGauge<M>(problem, k, d.x.size());
+
+    ceres::Solver::Options options;
+    tightOptions(options);
+    ceres::Solver::Summary summary;
+    ceres::Solve(options, &problem, &summary);
+    QVERIFY(summary.IsSolutionUsable());
+}
+
+template <class M>
+static void solveBatched(const testData &d, double *k, int block)
+{
+    ceres::Problem problem;
+    const int n=(int)d.x.size();
+    for(int i=0;i<n;i+=block)
+    {
+        problem.AddResidualBlock(new sphereFitBatch<M>(d.x.data()+i, d.y.data()+i, d.z.data()+i, std::min(block, n-i), SPHERE_FIT_HUBER), nullptr, k);
+    }
+    addGauge<M>(problem, k, d.x.size());
+
+    ceres::Solver::Options options;
+    tightOptions(options);
+    ceres::Solver::Summary summary;
+    ceres::Solve(options, &problem, &summary);
+    QVERIFY(summary.IsSolutionUsable());
+}
+
+template <class M>
+static void compareSolutions()
+{
+    testData d(5000);
+    double k0[M::nParams];
+    initial<M>(d, k0);
+
+    double ka[M::nParams], kb[M::nParams];
+    std::copy(k0, k0+M::nParams, ka);
+    std::copy(k0, k0+M::nParams, kb);
+    solveAutoDiff<M>(d, ka);
+    solveBatched<M>(d, kb, 512);
+
+    for(int j=0;j<M::nParams;j++)
+    {
+        QVERIFY2(std::abs(ka[j]-kb[j])<=1e-6*(1.0+std::abs(ka[j])),
+                 qPrintable(QString("%1 k[%2]: autodiff %3 batched %4").arg(M::name()).arg(j).arg(ka[j], 0, 'g', 17).arg(kb[j], 0, 'g', 17)));
+    }
+}
+
+// residual and jacobian of every sample, including the huber outliers
+template <class M>
+static void compareJacobian(const testData &d, const double *k)
+{
+    const int n=(int)d.x.size();
+    std::vector<double> g(n), Jb((size_t)n*M::nParams);
+    sphereFitBatch<M> batch(d.x.data(), d.y.data(), d.z.data(), n, SPHERE_FIT_HUBER);
+    const double *params[1]={k};
+    double *jb[1]={Jb.data()};
+    QVERIFY(batch.Evaluate(params, g.data(), jb));
+
+    ceres::HuberLoss loss(SPHERE_FIT_HUBER);
+    int outliers=0;
+    for(int i=0;i<n;i++)
+    {
+        std::unique_ptr<ceres::CostFunction> cost(sphereFit<M>::Create(d.x[i], d.y[i], d.z[i]));
+        double f, J[M::nParams];
+        double *ja[1]={J};
+        QVERIFY(cost->Evaluate(params, &f, ja));
+
+        // g = sign(f)*sqrt(rho(f^2)), dg = rho'(f^2)*|f|/sqrt(rho(f^2)) * df
+        double rho[3];
+        loss.Evaluate(f*f, rho);
+        const double eg=std::copysign(std::sqrt(rho[0]), f);
+        const double s=f!=0.0 ? rho[1]*std::abs(f)/std::sqrt(rho[0]) : 1.0;
+        if(std::abs(f)>SPHERE_FIT_HUBER) outliers++;
+
+        QVERIFY(std::abs(g[i]-eg)<=1e-12*(1.0+std::abs(eg)));
+        for(int j=0;j<M::nParams;j++)
+        {
+            const double e=s*J[j];
+            QVERIFY2(std::abs(Jb[(size_t)i*M::nParams+j]-e)<=1e-10*(1.0+std::abs(e)),
+                     qPrintable(QString("%1 sample %2 J[%3]").arg(M::name()).arg(i).arg(j)));
+        }
+    }
+    QVERIFY(outliers>0);
+}
+
+void tst_solver::jacobian()
+{
+    testData d(2000);
+
+    double kq[magModelQuadratic::nParams];
+    initial<magModelQuadratic>(d, kq);
+    compareJacobian<magModelQuadratic>(d, kq);
+
+    double ka[magModelAffine::nParams];
+    initial<magModelAffine>(d, ka);
+    compareJacobian<magModelAffine>(d, ka);
+}
+
+void tst_solver::solutionQuadratic()
+{
+    compareSolutions<magModelQuadratic>();
+}
+
+void tst_solver::solutionAffine()
+{
+    compareSolutions<magModelAffine>();
+}
+
+// solve() stops at the default ceres tolerances, close to the reference
+void tst_solver::solveMatches()
+{
+    testData d(5000);
+    magDataSpan s=d.span();
+
+    solverOptions options;
+    options.threads = 2;
+    options.verbose = 0;
+
+    double k0[magModelQuadratic::nParams];
+    initial<magModelQuadratic>(d, k0);
+    solveAutoDiff<magModelQuadratic>(d, k0);
+
+    QVector<double> k;
+    QVERIFY(solve(s, -1.0, d.t.back()+1.0, k, MAG_MODEL_QUADRATIC, 0, options));
+    QCOMPARE(k.size(), (int)magModelQuadratic::nParams);
+    for(int j=0;j<magModelQuadratic::nParams;j++)
+    {
+        QVERIFY2(std::abs(k[j]-k0[j])<=1e-4*(1.0+std::abs(k0[j])), qPrintable(QString("k[%1]").arg(j)));
+    }
+}
+
+// MAGCAL_SOLVER_BENCHMARK=1 tst_solver benchmark
+// one residual and jacobian evaluation and a full solve of 10^6 samples, single thread
+void tst_solver::benchmark()
+{
+    if(qEnvironmentVariableIsEmpty("MAGCAL_SOLVER_BENCHMARK")) QSKIP("set MAGCAL_SOLVER_BENCHMARK to run");
+
+    typedef magModelQuadratic M;
+    const int n=1000000;
+    testData d(n);
+    double k0[M::nParams];
+    initial<M>(d, k0);
+    const double *params[1]={k0};
+
+    std::vector<double> r(n), J((size_t)n*M::nParams);
+    QElapsedTimer timer;
+
+    std::vector<std::unique_ptr<ceres::CostFunction> > costs(n);
+    for(int i=0;i<n;i++) costs[i].reset(sphereFit<M>::Create(d.x[i], d.y[i], d.z[i]));
+    timer.start();
+    for(int i=0;i<n;i++)
+    {
+        double *j[1]={J.data()+(size_t)i*M::nParams};
+        costs[i]->Evaluate(params, r.data()+i, j);
+    }
+    const double autoDiffEval=timer.nsecsElapsed()*1e-6;
+
+    sphereFitBatch<M> batch(d.x.data(), d.y.data(), d.z.data(), n, SPHERE_FIT_HUBER);
+    double *jb[1]={J.data()};
+    timer.restart();
+    batch.Evaluate(params, r.data(), jb);
+    const double batchEval=timer.nsecsElapsed()*1e-6;
+
+    double ka[M::nParams], kb[M::nParams];
+    std::copy(k0, k0+M::nParams, ka);
+    std::copy(k0, k0+M::nParams, kb);
+    timer.restart();
+    solveAutoDiff<M>(d, ka);
+    const double autoDiffSolve=timer.nsecsElapsed()*1e-6;
+    timer.restart();
+    solveBatched<M>(d, kb, 4096);
+    const double batchSolve=timer.nsecsElapsed()*1e-6;
+
+    qInfo() << n << "samples, evaluation: autodiff" << autoDiffEval << "ms, batched" << batchEval << "ms";
+    qInfo() << n << "samples, solve: autodiff" << autoDiffSolve << "ms, batched" << batchSolve << "ms";
+}
+
+QTEST_APPLESS_MAIN(tst_solver)
+
+#include "tst_solver.moc"
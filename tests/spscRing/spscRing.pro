@@ -0,0 +1,11 @@
+include(../tests.pri)
+
+TARGET = tst_spscRing
+
+INCLUDEPATH += $$MAGCAL/magStream
+
+HEADERS += \
+    $$MAGCAL/magStream/spscRing.h
+
+SOURCES += \
+    tst_spscRing.cpp
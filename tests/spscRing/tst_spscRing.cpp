@@ -0,0 +1,175 @@
+/*
+MIT License
+
+Copyright (c) 2021 WagonWheelRobotics
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#include <QtTest>
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <thread>
+#include <vector>
+
+#include "spscRing.h"
+
+class tst_spscRing : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void capacity();
+    void wraparound();
+    void regions();
+    void pushFull();
+    void sizeClamp();
+};
+
+void tst_spscRing::capacity()
+{
+    QCOMPARE(spscRing<int>(1).capacity(), (size_t)1);
+    QCOMPARE(spscRing<int>(5).capacity(), (size_t)8);
+    QCOMPARE(spscRing<int>(64).capacity(), (size_t)64);
+    QCOMPARE(spscRing<int>(65).capacity(), (size_t)128);
+}
+
+// the indices run far past the capacity, the items keep their order
+void tst_spscRing::wraparound()
+{
+    spscRing<int> ring(8);
+    int next=0;
+    int expected=0;
+    for(int round=0;round<1000;round++)
+    {
+        const int n=1+round%7;
+        for(int i=0;i<n;i++) QVERIFY(ring.push(next++));
+        QCOMPARE(ring.size(), (size_t)n);
+        QCOMPARE(ring.free(), ring.capacity()-n);
+
+        int v[8];
+        QCOMPARE(ring.pop(v, 8), (size_t)n);
+        for(int i=0;i<n;i++) QCOMPARE(v[i], expected++);
+        QVERIFY(ring.empty());
+    }
+    QCOMPARE(ring.written(), (size_t)next);
+    QCOMPARE(ring.consumed(), (size_t)next);
+}
+
+// a region ends at the end of the storage, the rest follows from the start
+void tst_spscRing::regions()
+{
+    spscRing<uint8_t> ring(8);
+    uint8_t v[8];
+    for(int i=0;i<6;i++) QVERIFY(ring.push((uint8_t)i));
+    QCOMPARE(ring.pop(v, 6), (size_t)6);
+
+    size_t n;
+    uint8_t *w=ring.writeRegion(n);
+    QCOMPARE(n, (size_t)2);             // positions 6 and 7
+    w[0] = 10;
+    w[1] = 11;
+    ring.commitWrite(2);
+    w=ring.writeRegion(n);
+    QCOMPARE(n, (size_t)6);             // wrapped, 0..5
+    for(int i=0;i<3;i++) w[i] = (uint8_t)(12+i);
+    ring.commitWrite(3);
+    QCOMPARE(ring.size(), (size_t)5);
+
+    const uint8_t *r=ring.readRegion(n);
+    QCOMPARE(n, (size_t)2);
+    QCOMPARE(r[0], (uint8_t)10);
+    QCOMPARE(r[1], (uint8_t)11);
+    ring.commitRead(2);
+    r=ring.readRegion(n);
+    QCOMPARE(n, (size_t)3);
+    for(int i=0;i<3;i++) QCOMPARE(r[i], (uint8_t)(12+i));
+    ring.commitRead(3);
+    QVERIFY(ring.empty());
+}
+
+void tst_spscRing::pushFull()
+{
+    spscRing<int> ring(4);
+    const int v[5]={1, 2, 3, 4, 5};
+    QVERIFY(ring.push(v, 3));
+    QVERIFY(!ring.push(v, 2));          // all or nothing
+    QCOMPARE(ring.size(), (size_t)3);
+    QVERIFY(ring.push(v+3, 1));
+    QVERIFY(!ring.push(v+4, 1));
+    QCOMPARE(ring.free(), (size_t)0);
+
+    size_t n;
+    ring.writeRegion(n);
+    QCOMPARE(n, (size_t)0);
+}
+
+// size() from a third thread while the producer refills what the consumer frees
+void tst_spscRing::sizeClamp()
+{
+    spscRing<uint32_t> ring(16);
+    const uint32_t total=1000000;
+    std::atomic<bool> ordered(true);
+    std::atomic<bool> done(false);
+
+    std::thread producer([&]()
+    {
+        uint32_t i=0;
+        while(i<total)
+        {
+            if(ring.push(i)) i++;
+            else std::this_thread::yield();
+        }
+    });
+    std::thread consumer([&]()
+    {
+        uint32_t expected=0;
+        uint32_t v[5];
+        while(expected<total)
+        {
+            const size_t n=ring.pop(v, 5);
+            if(n==0) std::this_thread::yield();
+            for(size_t j=0;j<n;j++)
+            {
+                if(v[j]!=expected++) ordered = false;
+            }
+        }
+        done = true;
+    });
+
+    size_t maxSize=0;
+    while(!done)
+    {
+        for(int i=0;i<100;i++) maxSize = std::max(maxSize, ring.size());
+        std::this_thread::sleep_for(std::chrono::microseconds(50));     // the workers may share a core
+    }
+    producer.join();
+    consumer.join();
+
+    QVERIFY(ordered);
+    QVERIFY(maxSize<=ring.capacity());
+    QVERIFY(ring.empty());
+    QCOMPARE(ring.written(), (size_t)total);
+}
+
+QTEST_APPLESS_MAIN(tst_spscRing)
+
+#include "tst_spscRing.moc"
@@ -0,0 +1,12 @@
+# common settings of the test projects, a test adds the sources it tests
+
+QT += testlib
+QT -= gui
+
+CONFIG += c++17 console testcase
+CONFIG -= app_bundle
+
+MAGCAL = $$PWD/..
+
+INCLUDEPATH += $$MAGCAL/utils
+HEADERS += $$MAGCAL/utils/parallel.h
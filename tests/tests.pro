@@ -0,0 +1,11 @@
+# unit tests, qmake tests/tests.pro && make check
+
+TEMPLATE = subdirs
+
+SUBDIRS += \
+    magApply \
+    magBin \
+    magLogParser \
+    magWire \
+    solver \
+    spscRing
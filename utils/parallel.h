@@ -0,0 +1,77 @@
+#ifndef PARALLEL_H
+#define PARALLEL_H
+
+/*
+MIT License
+
+Copyright (c) 2021 WagonWheelRobotics
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <thread>
+#include <vector>
+
+namespace parallel
+{
+
+// number of worker threads, 0 or negative means all cores
+inline int threads(int requested=0)
+{
+    if(requested>0) return requested;
+    int n=(int)std::thread::hardware_concurrency();
+    return n>0 ? n : 1;
+}
+
+// calls f(index, worker) for index=0..n-1 on a pool of worker threads
+// items are handed out one by one, so uneven items are balanced between workers
+template <typename F> void forEach(size_t n, F f, int nThreads=0)
+{
+    if(n==0) return;
+    int nWorker=(int)std::min<size_t>((size_t)threads(nThreads), n);
+    if(nWorker<=1)
+    {
+        for(size_t i=0;i<n;i++) f(i,0);
+        return;
+    }
+
+    std::atomic<size_t> next(0);
+    auto worker=[&](int id)
+    {
+        for(;;)
+        {
+            size_t i=next.fetch_add(1);
+            if(i>=n) break;
+            f(i,id);
+        }
+    };
+
+    std::vector<std::thread> pool;
+    pool.reserve(nWorker-1);
+    for(int i=1;i<nWorker;i++) pool.emplace_back(worker,i);
+    worker(0);
+    for(auto &t:pool) t.join();
+}
+
+} // namespace parallel
+
+#endif // PARALLEL_H
@@ -42,6 +42,10 @@ serialPortDialog::serialPortDialog(QWidget *parent) :
     ui->cbParity->addItem("Even",QSerialPort::EvenParity);
     ui->cbParity->addItem("Odd",QSerialPort::OddParity);
 
+    ui->cbFraming->addItem("Text rows",0);
+    ui->cbFraming->addItem("Length prefixed (uint16 LE)",1);
+    ui->cbFraming->addItem("Binary frames (COBS)",2);
+
     configStorage s("serialPortDialog", this);
     QVariantMap m=s.load("last");
     if(m.contains("port"))
@@ -68,6 +72,15 @@ serialPortDialog::serialPortDialog(QWidget *parent) :
         auto i=ui->cbStop->findData(m["stop"]);
         if(i>=0) ui->cbStop->setCurrentIndex(i);
     }
+    if(m.contains("framing"))
+    {
+        auto i=ui->cbFraming->findData(m["framing"]);
+        if(i>=0) ui->cbFraming->setCurrentIndex(i);
+    }
+    if(m.contains("forgetting"))
+    {
+        ui->sbForgetting->setValue(m["forgetting"].toDouble());
+    }
 
 }
 
@@ -87,6 +100,17 @@ QSerialPort *serialPortDialog::get(QObject *parent)
     return p;
 }
 
+int serialPortDialog::framing() const
+{
+    return ui->cbFraming->currentData().toInt();
+}
+
+// forgetting factor of the online fit (magOnlineCalib)
+double serialPortDialog::forgetting() const
+{
+    return ui->sbForgetting->value();
+}
+
 void serialPortDialog::on_buttonBox_accepted()
 {
     QVariantMap m;
@@ -95,6 +119,8 @@ void serialPortDialog::on_buttonBox_accepted()
     m["parity"] = ui->cbParity->currentData();
     m["data"] = ui->cbData->currentData();
     m["stop"] = ui->cbStop->currentData();
+    m["framing"] = ui->cbFraming->currentData();
+    m["forgetting"] = ui->sbForgetting->value();
 
     configStorage s("serialPortDialog", this);
     s.save(m,"last");
@@ -17,6 +17,8 @@ public:
     explicit serialPortDialog(QWidget *parent = nullptr);
     ~serialPortDialog();
     virtual QSerialPort *get(QObject *parent);
+    int framing() const;
+    double forgetting() const;
 
 private slots:
     void on_buttonBox_accepted();
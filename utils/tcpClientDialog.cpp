@@ -59,6 +59,8 @@ void tcpClientDialog::load(void)
     auto params = s.load("last");
     if(params.contains("lePort")) ui->lePort->setText(params["lePort"].toString());
     if(params.contains("leAddr")) ui->leAddr->setText(params["leAddr"].toString());
+    if(params.contains("cbFraming")) ui->cbFraming->setCurrentIndex(params["cbFraming"].toInt());
+    if(params.contains("sbForgetting")) ui->sbForgetting->setValue(params["sbForgetting"].toDouble());
 }
 
 
@@ -66,6 +68,8 @@ void tcpClientDialog::load(void)
 void tcpClientDialog::on_buttonBox_accepted()
 {
     _param["leAddr"] = ui->leAddr->text();
+    _param["cbFraming"] = ui->cbFraming->currentIndex();
+    _param["sbForgetting"] = ui->sbForgetting->value();
     bool ok;
     int port=ui->lePort->text().toInt(&ok);
     if(ok && port>0 && port<65536)
@@ -11,6 +11,7 @@ HEADERS += \
     $$PWD/customMdiSubWindow.h \
     $$PWD/interp1d.h \
     $$PWD/logging.h \
+    $$PWD/parallel.h \
     $$PWD/serialPortDialog.h \
     $$PWD/tcpClientDialog.h
 